@@ -0,0 +1,59 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include "analyzer.h"
+#include "mapped_file.h"
+#include "rom_hash.h"
+
+// Runs the static analyzer over ROMs, with an optional on-disk cache and disassembly listing.
+int main(int argc, char **argv) {
+    char const* cache_dir = nullptr;
+    bool disassemble = false;
+    int first_rom = 1;
+
+    for (; first_rom < argc && argv[first_rom][0] == '-'; ++first_rom) {
+        if (strcmp(argv[first_rom], "--cache") == 0 && first_rom + 1 < argc)
+            cache_dir = argv[++first_rom];
+        else if (strcmp(argv[first_rom], "--disasm") == 0)
+            disassemble = true;
+        else
+            break;
+    }
+
+    if (first_rom >= argc) {
+        std::cerr << "Usage: " << argv[0] << " [--cache <dir>] [--disasm] <ROM>...\n";
+        return 1;
+    }
+
+    // Bitmaps are 32 KB, keep them off the stack.
+    std::unique_ptr<RomAnalysis> analysis(new RomAnalysis);
+
+    for (int i = first_rom; i < argc; ++i) {
+        MappedFile rom;
+        if (!rom.Open(argv[i]) || rom.Size() > RomAnalysis::ADDRESS_SPACE - 0x200) {
+            std::cerr << "Skipping " << argv[i] << ", can't read it or it is too large.\n";
+            continue;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        bool cached = cache_dir && LoadCachedAnalysis(cache_dir, HashRom(rom.Data(), rom.Size()), *analysis);
+        if (!cached) {
+            AnalyzeRom(rom.Data(), rom.Size(), *analysis);
+            if (cache_dir)
+                SaveCachedAnalysis(cache_dir, *analysis);
+        }
+        double micros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+        printf("%s %016llX code %zu/%u blocks %zu calls %zu tables %zu %s %.1fus\n", argv[i],
+               static_cast<unsigned long long>(analysis->rom_hash), analysis->code.count(), analysis->rom_size,
+               analysis->block_starts.count(), analysis->calls.size(), analysis->jump_tables.size(),
+               cached ? "cached" : "analyzed", micros);
+
+        if (disassemble)
+            PrintDisassembly(std::cout, rom.Data(), *analysis);
+    }
+
+    return 0;
+}
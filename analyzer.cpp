@@ -0,0 +1,312 @@
+#include "analyzer.h"
+#include "rom_hash.h"
+#include <cstdio>
+#include <fstream>
+
+namespace {
+
+const uint16_t ROM_START = 0x200;
+const int MAX_JUMP_TABLE = 128; // Entries scanned after a BNNN base.
+
+inline uint16_t ReadWord(unsigned char const* rom, size_t size, uint32_t address) {
+    uint32_t offset = address - ROM_START;
+    if (offset + 1 >= size)
+        return 0;
+    return rom[offset] << 8 | rom[offset + 1];
+}
+
+inline bool InRom(size_t size, uint32_t address) {
+    return address >= ROM_START && address + 1 < ROM_START + size;
+}
+
+inline int InstructionLength(uint16_t opcode) {
+    return opcode == 0xF000 ? 4 : 2;
+}
+
+inline bool IsSkip(uint16_t opcode) {
+    switch (opcode & 0xF000) {
+        case 0x3000:
+        case 0x4000:
+            return true;
+        case 0x5000:
+        case 0x9000:
+            return (opcode & 0x000F) == 0;
+        case 0xE000:
+            return (opcode & 0x00FF) == 0x9E || (opcode & 0x00FF) == 0xA1;
+        default:
+            return false;
+    }
+}
+
+}
+
+void AnalyzeRom(unsigned char const* rom, size_t size, RomAnalysis& analysis) {
+    analysis.rom_hash = HashRom(rom, size);
+    analysis.rom_size = static_cast<uint32_t>(size);
+    analysis.code.reset();
+    analysis.block_starts.reset();
+    analysis.jump_targets.reset();
+    analysis.call_targets.reset();
+    analysis.calls.clear();
+    analysis.jump_tables.clear();
+
+    std::vector<uint32_t> work;
+    work.push_back(ROM_START);
+    analysis.block_starts.set(ROM_START);
+
+    // Marks a branch target as a block start and queues it once.
+    auto branch = [&](uint32_t target, std::bitset<RomAnalysis::ADDRESS_SPACE>& kind) {
+        if (!InRom(size, target))
+            return;
+        kind.set(target);
+        analysis.block_starts.set(target);
+        if (!analysis.code.test(target))
+            work.push_back(target);
+    };
+
+    while (!work.empty()) {
+        uint32_t address = work.back();
+        work.pop_back();
+
+        // Follow straight line code until something ends the block.
+        while (InRom(size, address) && !analysis.code.test(address)) {
+            uint16_t opcode = ReadWord(rom, size, address);
+            int length = InstructionLength(opcode);
+            for (int i = 0; i < length && address + i < RomAnalysis::ADDRESS_SPACE; ++i)
+                analysis.code.set(address + i);
+
+            uint32_t next = address + length;
+            bool ends_block = false;
+
+            if (opcode == 0x00EE || opcode == 0x00FD) {
+                ends_block = true;
+            }
+            else if ((opcode & 0xF000) == 0x1000) {
+                branch(opcode & 0x0FFF, analysis.jump_targets);
+                ends_block = true;
+            }
+            else if ((opcode & 0xF000) == 0x2000) {
+                analysis.calls.push_back({ static_cast<uint16_t>(address), static_cast<uint16_t>(opcode & 0x0FFF) });
+                branch(opcode & 0x0FFF, analysis.call_targets);
+                if (InRom(size, next))
+                    analysis.block_starts.set(next);
+            }
+            else if ((opcode & 0xF000) == 0xB000) {
+                // Jump tables are runs of jumps at NNN, one per value of V0 the ROM expects.
+                uint32_t base = opcode & 0x0FFF;
+                analysis.jump_tables.push_back(static_cast<uint16_t>(base));
+                branch(base, analysis.jump_targets);
+                for (int entry = 1; entry < MAX_JUMP_TABLE && InRom(size, base + entry * 2); ++entry) {
+                    if ((ReadWord(rom, size, base + entry * 2) & 0xF000) != 0x1000)
+                        break;
+                    branch(base + entry * 2, analysis.jump_targets);
+                }
+                ends_block = true;
+            }
+            else if (IsSkip(opcode)) {
+                // Both the next instruction and the one after it start blocks.
+                // Past the end of a full size ROM there is neither.
+                uint32_t skipped = next + InstructionLength(ReadWord(rom, size, next));
+                if (InRom(size, next))
+                    analysis.block_starts.set(next);
+                branch(skipped, analysis.jump_targets);
+            }
+
+            if (ends_block)
+                break;
+            address = next;
+        }
+    }
+}
+
+// Cache file: magic, hash, size, then the four bitmaps restricted to the ROM and the call edges.
+static std::string CachePath(char const* cache_dir, uint64_t rom_hash) {
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.c8a", static_cast<unsigned long long>(rom_hash));
+    return std::string(cache_dir) + name;
+}
+
+static const char CACHE_MAGIC[8] = "C8ANLZ1";
+
+bool LoadCachedAnalysis(char const* cache_dir, uint64_t rom_hash, RomAnalysis& analysis) {
+    std::ifstream file(CachePath(cache_dir, rom_hash), std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    char magic[8];
+    uint64_t hash;
+    uint32_t rom_size, call_count, table_count;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&hash), sizeof(hash));
+    file.read(reinterpret_cast<char*>(&rom_size), sizeof(rom_size));
+    if (!file || std::string(magic, 8) != std::string(CACHE_MAGIC, 8) || hash != rom_hash || rom_size > RomAnalysis::ADDRESS_SPACE - ROM_START)
+        return false;
+
+    analysis.rom_hash = hash;
+    analysis.rom_size = rom_size;
+    for (auto* bits : { &analysis.code, &analysis.block_starts, &analysis.jump_targets, &analysis.call_targets }) {
+        bits->reset();
+        std::vector<unsigned char> packed((rom_size + 7) / 8);
+        file.read(reinterpret_cast<char*>(packed.data()), packed.size());
+        for (uint32_t i = 0; i < rom_size; ++i)
+            if (packed[i / 8] & (1 << (i % 8)))
+                bits->set(ROM_START + i);
+    }
+
+    file.read(reinterpret_cast<char*>(&call_count), sizeof(call_count));
+    if (!file || call_count > RomAnalysis::ADDRESS_SPACE)
+        return false;
+    analysis.calls.resize(call_count);
+    file.read(reinterpret_cast<char*>(analysis.calls.data()), call_count * sizeof(analysis.calls[0]));
+
+    file.read(reinterpret_cast<char*>(&table_count), sizeof(table_count));
+    if (!file || table_count > RomAnalysis::ADDRESS_SPACE)
+        return false;
+    analysis.jump_tables.resize(table_count);
+    file.read(reinterpret_cast<char*>(analysis.jump_tables.data()), table_count * sizeof(analysis.jump_tables[0]));
+
+    return static_cast<bool>(file);
+}
+
+bool SaveCachedAnalysis(char const* cache_dir, RomAnalysis const& analysis) {
+    std::ofstream file(CachePath(cache_dir, analysis.rom_hash), std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+        return false;
+
+    file.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    file.write(reinterpret_cast<char const*>(&analysis.rom_hash), sizeof(analysis.rom_hash));
+    file.write(reinterpret_cast<char const*>(&analysis.rom_size), sizeof(analysis.rom_size));
+    for (auto* bits : { &analysis.code, &analysis.block_starts, &analysis.jump_targets, &analysis.call_targets }) {
+        std::vector<unsigned char> packed((analysis.rom_size + 7) / 8);
+        for (uint32_t i = 0; i < analysis.rom_size; ++i)
+            if (bits->test(ROM_START + i))
+                packed[i / 8] |= 1 << (i % 8);
+        file.write(reinterpret_cast<char const*>(packed.data()), packed.size());
+    }
+
+    uint32_t call_count = static_cast<uint32_t>(analysis.calls.size());
+    file.write(reinterpret_cast<char const*>(&call_count), sizeof(call_count));
+    file.write(reinterpret_cast<char const*>(analysis.calls.data()), call_count * sizeof(analysis.calls[0]));
+
+    uint32_t table_count = static_cast<uint32_t>(analysis.jump_tables.size());
+    file.write(reinterpret_cast<char const*>(&table_count), sizeof(table_count));
+    file.write(reinterpret_cast<char const*>(analysis.jump_tables.data()), table_count * sizeof(analysis.jump_tables[0]));
+
+    return static_cast<bool>(file);
+}
+
+std::string DisassembleInstruction(uint16_t opcode, uint16_t next) {
+    char text[32];
+    unsigned x = (opcode & 0x0F00) >> 8;
+    unsigned y = (opcode & 0x00F0) >> 4;
+    unsigned n = opcode & 0x000F;
+    unsigned nn = opcode & 0x00FF;
+    unsigned nnn = opcode & 0x0FFF;
+
+    switch (opcode & 0xF000) {
+        case 0x0000:
+            switch (nn) {
+                case 0xE0: return "CLS";
+                case 0xEE: return "RET";
+                case 0xFB: return "SCR";
+                case 0xFC: return "SCL";
+                case 0xFD: return "EXIT";
+                case 0xFE: return "LOW";
+                case 0xFF: return "HIGH";
+            }
+            if ((nn & 0xF0) == 0xC0)
+                snprintf(text, sizeof(text), "SCD %u", n);
+            else if ((nn & 0xF0) == 0xD0)
+                snprintf(text, sizeof(text), "SCU %u", n);
+            else
+                snprintf(text, sizeof(text), "SYS 0x%03X", nnn);
+        break;
+
+        case 0x1000: snprintf(text, sizeof(text), "JP 0x%03X", nnn); break;
+        case 0x2000: snprintf(text, sizeof(text), "CALL 0x%03X", nnn); break;
+        case 0x3000: snprintf(text, sizeof(text), "SE V%X, 0x%02X", x, nn); break;
+        case 0x4000: snprintf(text, sizeof(text), "SNE V%X, 0x%02X", x, nn); break;
+        case 0x5000:
+            if (n == 0)
+                snprintf(text, sizeof(text), "SE V%X, V%X", x, y);
+            else if (n == 2)
+                snprintf(text, sizeof(text), "SAVE V%X - V%X", x, y);
+            else if (n == 3)
+                snprintf(text, sizeof(text), "LOAD V%X - V%X", x, y);
+            else
+                snprintf(text, sizeof(text), "DW 0x%04X", opcode);
+        break;
+        case 0x6000: snprintf(text, sizeof(text), "LD V%X, 0x%02X", x, nn); break;
+        case 0x7000: snprintf(text, sizeof(text), "ADD V%X, 0x%02X", x, nn); break;
+        case 0x8000: {
+            static char const* const names[16] = { "LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN",
+                                                   nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, "SHL", nullptr };
+            if (names[n])
+                snprintf(text, sizeof(text), "%s V%X, V%X", names[n], x, y);
+            else
+                snprintf(text, sizeof(text), "DW 0x%04X", opcode);
+        }
+        break;
+        case 0x9000: snprintf(text, sizeof(text), "SNE V%X, V%X", x, y); break;
+        case 0xA000: snprintf(text, sizeof(text), "LD I, 0x%03X", nnn); break;
+        case 0xB000: snprintf(text, sizeof(text), "JP V0, 0x%03X", nnn); break;
+        case 0xC000: snprintf(text, sizeof(text), "RND V%X, 0x%02X", x, nn); break;
+        case 0xD000: snprintf(text, sizeof(text), "DRW V%X, V%X, %u", x, y, n); break;
+        case 0xE000:
+            if (nn == 0x9E)
+                snprintf(text, sizeof(text), "SKP V%X", x);
+            else if (nn == 0xA1)
+                snprintf(text, sizeof(text), "SKNP V%X", x);
+            else
+                snprintf(text, sizeof(text), "DW 0x%04X", opcode);
+        break;
+        case 0xF000:
+            switch (nn) {
+                case 0x00: snprintf(text, sizeof(text), "LD I, 0x%04X", next); break;
+                case 0x01: snprintf(text, sizeof(text), "PLANE %u", x); break;
+                case 0x02: snprintf(text, sizeof(text), "AUDIO"); break;
+                case 0x07: snprintf(text, sizeof(text), "LD V%X, DT", x); break;
+                case 0x0A: snprintf(text, sizeof(text), "LD V%X, K", x); break;
+                case 0x15: snprintf(text, sizeof(text), "LD DT, V%X", x); break;
+                case 0x18: snprintf(text, sizeof(text), "LD ST, V%X", x); break;
+                case 0x1E: snprintf(text, sizeof(text), "ADD I, V%X", x); break;
+                case 0x29: snprintf(text, sizeof(text), "LD F, V%X", x); break;
+                case 0x30: snprintf(text, sizeof(text), "LD HF, V%X", x); break;
+                case 0x33: snprintf(text, sizeof(text), "LD B, V%X", x); break;
+                case 0x3A: snprintf(text, sizeof(text), "PITCH V%X", x); break;
+                case 0x55: snprintf(text, sizeof(text), "LD [I], V%X", x); break;
+                case 0x65: snprintf(text, sizeof(text), "LD V%X, [I]", x); break;
+                case 0x75: snprintf(text, sizeof(text), "LD R, V%X", x); break;
+                case 0x85: snprintf(text, sizeof(text), "LD V%X, R", x); break;
+                default: snprintf(text, sizeof(text), "DW 0x%04X", opcode);
+            }
+        break;
+    }
+
+    return text;
+}
+
+void PrintDisassembly(std::ostream& out, unsigned char const* rom, RomAnalysis const& analysis) {
+    char line[64];
+    uint32_t end = ROM_START + analysis.rom_size;
+
+    for (uint32_t address = ROM_START; address < end;) {
+        if (analysis.call_targets.test(address))
+            out << "\nsub_" << std::hex << address << std::dec << ":\n";
+        else if (analysis.block_starts.test(address))
+            out << "\nlabel_" << std::hex << address << std::dec << ":\n";
+
+        if (analysis.code.test(address) && address + 1 < end) {
+            uint16_t opcode = ReadWord(rom, analysis.rom_size, address);
+            uint16_t next = ReadWord(rom, analysis.rom_size, address + 2);
+            snprintf(line, sizeof(line), "  %03X: %04X  ", address, opcode);
+            out << line << DisassembleInstruction(opcode, next) << "\n";
+            address += InstructionLength(opcode);
+        }
+        else {
+            snprintf(line, sizeof(line), "  %03X: %02X    DB 0x%02X\n", address, rom[address - ROM_START], rom[address - ROM_START]);
+            out << line;
+            ++address;
+        }
+    }
+}
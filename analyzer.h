@@ -0,0 +1,38 @@
+#ifndef ANALYZER_H
+#define ANALYZER_H
+
+#include <bitset>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Static control flow analysis of a ROM, walked from 0x200 without running it.
+// Bitmaps are indexed by address, the ROM itself starts at 0x200.
+struct RomAnalysis {
+    static constexpr int ADDRESS_SPACE = 65536;
+
+    uint64_t rom_hash = 0;
+    uint32_t rom_size = 0;
+    std::bitset<ADDRESS_SPACE> code; // Bytes that belong to reachable instructions.
+    std::bitset<ADDRESS_SPACE> block_starts; // First instruction of every basic block.
+    std::bitset<ADDRESS_SPACE> jump_targets; // Targets of 1NNN, BNNN tables and skips.
+    std::bitset<ADDRESS_SPACE> call_targets; // Subroutine entry points.
+    std::vector<std::pair<uint16_t, uint16_t>> calls; // Call graph edges: (2NNN address, callee).
+    std::vector<uint16_t> jump_tables; // Bases of BNNN jump tables.
+};
+
+// Walks the ROM following jumps, calls, skips and BNNN tables.
+void AnalyzeRom(unsigned char const* rom, size_t size, RomAnalysis& analysis);
+
+// On-disk cache, one file per ROM hash in cache_dir. Load returns false on a miss.
+bool LoadCachedAnalysis(char const* cache_dir, uint64_t rom_hash, RomAnalysis& analysis);
+bool SaveCachedAnalysis(char const* cache_dir, RomAnalysis const& analysis);
+
+// Cowgod style mnemonic for one instruction. next is the following word, used by F000 NNNN.
+std::string DisassembleInstruction(uint16_t opcode, uint16_t next);
+
+// Code/data listing of the whole ROM with labels for blocks and subroutines.
+void PrintDisassembly(std::ostream& out, unsigned char const* rom, RomAnalysis const& analysis);
+
+#endif
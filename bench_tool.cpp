@@ -0,0 +1,337 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+#include "chip8.h"
+#include "mapped_file.h"
+#include "pixel_expand.h"
+#include "ram_search.h"
+#include "romdb.h"
+#include "rompack.h"
+#include "simd.h"
+
+namespace {
+
+// Best time per call of body over a few rounds of calls, in nanoseconds. The first round warms caches up.
+template <typename Body>
+double NsPerCall(int calls, Body body) {
+    double best = 1e300;
+    for (int round = 0; round < 6; ++round) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < calls; ++i)
+            body();
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / calls;
+        if (round > 0)
+            best = std::min(best, ns);
+    }
+    return best;
+}
+
+// Keeps the compiler from dropping work whose result is never read.
+void Consume(void const* data) {
+    asm volatile("" : : "r"(data) : "memory");
+}
+
+// Pixel expansion into a texture sized buffer: the per pixel ternary Platform::Update had before the kernels,
+// then the kernels on a byte per pixel screen and on one and two packed planes, unscaled and upscaled.
+void BenchExpand() {
+    struct Case {
+        int width;
+        int height;
+        int scale;
+    };
+    const Case CASES[] = { { 64, 32, 1 }, { 128, 64, 1 }, { 64, 32, 10 }, { 128, 64, 5 } };
+    const uint32_t PALETTE[4] = { 0x000000FF, 0xFFFFFFFF, 0xAAAAAAFF, 0x555555FF };
+
+    printf("expand kernels %s\n", SimdLevelName(GetSimdLevel()));
+    for (Case const& c : CASES) {
+        int out_width = c.width * c.scale;
+        int out_height = c.height * c.scale;
+        std::vector<uint32_t> out(out_width * out_height);
+        std::vector<unsigned char> bytes(c.width * c.height);
+        PackedRow planes[2][64] = {};
+        for (int y = 0; y < c.height; ++y)
+            for (int x = 0; x < c.width; ++x) {
+                bool on = (x * 7 + y * 13) % 5 < 2;
+                bool on2 = (x + y) % 3 == 0;
+                bytes[y * c.width + x] = on | on2 << 1;
+                planes[0][y] |= static_cast<PackedRow>(on) << (127 - x);
+                planes[1][y] |= static_cast<PackedRow>(on2) << (127 - x);
+            }
+
+        int calls = std::max(10, 20000000 / (out_width * out_height));
+        // The ternary only ever filled a screen sized texture, SDL did the scaling.
+        double ternary = c.scale > 1 ? 0.0 : NsPerCall(calls, [&]() {
+            for (int i = 0; i < c.width * c.height; ++i)
+                out[i] = bytes[i] ? 0xFFFFFFFF : 0x000000FF;
+            Consume(out.data());
+        });
+        double byte_kernel = NsPerCall(calls, [&]() {
+            ExpandPixels(bytes.data(), c.width, c.height, PALETTE, out.data(), out_width * 4, c.scale);
+            Consume(out.data());
+        });
+        double one_plane = NsPerCall(calls, [&]() {
+            ExpandPackedPixels(planes[0], nullptr, c.width, c.height, PALETTE, out.data(), out_width * 4, c.scale);
+            Consume(out.data());
+        });
+        double two_planes = NsPerCall(calls, [&]() {
+            ExpandPackedPixels(planes[0], planes[1], c.width, c.height, PALETTE, out.data(), out_width * 4, c.scale);
+            Consume(out.data());
+        });
+
+        char ternary_text[16] = "-";
+        if (ternary > 0.0)
+            snprintf(ternary_text, sizeof(ternary_text), "%.0f", ternary);
+        printf("  %3dx%-3d x%-2d -> %4dx%-4d ternary %8s ns  bytes %8.0f ns  1 plane %8.0f ns  2 planes %8.0f ns\n",
+               c.width, c.height, c.scale, out_width, out_height, ternary_text, byte_kernel, one_plane, two_planes);
+    }
+}
+
+// Key to photon latency of polling input once at the frame start against polling at the frame's first key read.
+// The same host key events, at random times, are fed to the core both ways over emulated time, and an event counts
+// as shown at the end of the frame the core applied it in, when that frame is presented.
+void BenchInput(char const* rom) {
+    const uint64_t FRAME_NS = 1000000000 / 60;
+    const int FRAMES = 36000;
+
+    std::unique_ptr<chip8> start(new chip8);
+    start->Initialize();
+    start->SetSeed(1);
+    start->LoadGame(rom);
+    MachineSetup setup;
+    ResolveMachine(start->GetRomSha1(), nullptr, 0, setup);
+    start->SetQuirks(setup.quirks);
+    start->SetCyclesPerSecond((setup.cycles_per_frame ? setup.cycles_per_frame : 9) * 60);
+
+    // A tap every 10 frames on average, held for a few frames, on every key in turn.
+    std::vector<KeyEvent> host_events;
+    std::mt19937_64 random(1);
+    for (uint64_t time = 0; time < FRAMES * FRAME_NS;) {
+        uint8_t key = host_events.size() / 2 % 16;
+        time += random() % (FRAME_NS * 16);
+        host_events.push_back({ time, key, true });
+        time += FRAME_NS * 2 + random() % (FRAME_NS * 4);
+        host_events.push_back({ time, key, false });
+    }
+
+    for (bool just_in_time : { false, true }) {
+        std::unique_ptr<chip8> machine(new chip8(*start));
+        KeyEventQueue queue;
+        machine->SetInputQueue(&queue);
+
+        size_t next = 0;
+        auto forward_until = [&](uint64_t time) {
+            for (; next < host_events.size() && host_events[next].timestamp < time; ++next)
+                queue.Push(host_events[next]);
+        };
+
+        uint64_t frame_start = 0;
+        uint64_t frame_first_cycle = 0;
+        int frame_cycles = 0;
+        if (just_in_time)
+            machine->SetInputHook([&]() {
+                forward_until(frame_start + (machine->GetCycleCount() - frame_first_cycle) * FRAME_NS / std::max(frame_cycles, 1));
+            });
+
+        std::vector<uint64_t> latencies;
+        machine->SetKeyListener([&](KeyEvent const& event) {
+            latencies.push_back(frame_start + FRAME_NS - event.timestamp);
+        });
+
+        for (int frame = 0; frame < FRAMES && machine->GetStatus() == Status::Running; ++frame) {
+            frame_start = frame * FRAME_NS;
+            frame_first_cycle = machine->GetCycleCount();
+            frame_cycles = machine->GetFrameCycles(1);
+            if (!just_in_time)
+                forward_until(frame_start);
+            machine->RunCycles(frame_cycles, frame_start, frame_start + FRAME_NS);
+            if (just_in_time && !machine->GetInputPolled())
+                forward_until(frame_start + FRAME_NS);
+        }
+
+        std::sort(latencies.begin(), latencies.end());
+        double mean = 0.0;
+        for (uint64_t latency : latencies)
+            mean += latency / 1e6;
+        mean = latencies.empty() ? 0.0 : mean / latencies.size();
+        auto percentile = [&](int p) {
+            return latencies.empty() ? 0.0 : latencies[(latencies.size() - 1) * p / 100] / 1e6;
+        };
+        printf("input %-13s events %zu mean_ms %.2f p50_ms %.2f p99_ms %.2f\n", just_in_time ? "just-in-time" : "frame-start",
+               latencies.size(), mean, percentile(50), percentile(99));
+    }
+}
+
+// Loading every ROM of a directory into a fresh machine, one job per ROM: read by LoadGame(filename), mapped one
+// file at a time, and copied out of a pack that is mapped once.
+void BenchLoad(char const* directory) {
+    std::vector<RomPack::Input> roms;
+    for (auto const& entry : std::filesystem::recursive_directory_iterator(directory)) {
+        if (!entry.is_regular_file() || entry.file_size() == 0 || entry.file_size() > 65536 - 0x200)
+            continue;
+        std::ifstream file(entry.path(), std::ios::binary);
+        RomPack::Input rom;
+        rom.name = entry.path().string();
+        rom.data.resize(entry.file_size());
+        file.read(reinterpret_cast<char*>(rom.data.data()), rom.data.size());
+        roms.push_back(std::move(rom));
+    }
+    if (roms.empty()) {
+        std::cerr << "No ROMs in " << directory << "\n";
+        return;
+    }
+
+    std::string pack_file = (std::filesystem::temp_directory_path() / "chip8-bench.c8pack").string();
+    if (!RomPack::Build(pack_file.c_str(), roms)) {
+        std::cerr << "Failed to write " << pack_file << "\n";
+        return;
+    }
+
+    std::unique_ptr<chip8> machine(new chip8);
+    double ifstream_ns = NsPerCall(1, [&]() {
+        for (RomPack::Input const& rom : roms) {
+            machine->Initialize();
+            machine->LoadGame(rom.name.c_str());
+        }
+    }) / roms.size();
+    double mapped_ns = NsPerCall(1, [&]() {
+        for (RomPack::Input const& rom : roms) {
+            MappedFile file;
+            file.Open(rom.name.c_str());
+            machine->Initialize();
+            machine->LoadGame(file.Data(), file.Size());
+        }
+    }) / roms.size();
+
+    RomPack pack;
+    double open_ns = NsPerCall(1, [&]() { pack.Open(pack_file.c_str()); });
+    double pack_ns = NsPerCall(1, [&]() {
+        for (uint32_t i = 0; i < pack.Count(); ++i) {
+            machine->Initialize();
+            machine->LoadGame(pack.Data(pack.Entry(i)), pack.Entry(i).size);
+        }
+    }) / pack.Count();
+
+    // What every job pays anyway: clearing the machine and hashing the ROM as it is copied in.
+    double machine_ns = NsPerCall(1, [&]() {
+        for (RomPack::Input const& rom : roms) {
+            machine->Initialize();
+            machine->LoadGame(rom.data.data(), rom.data.size());
+        }
+    }) / roms.size();
+    std::filesystem::remove(pack_file);
+
+    printf("load %zu ROMs per job: ifstream %.0f ns  mapped file %.0f ns  pack %.0f ns  from memory %.0f ns, pack open %.0f ns once\n",
+           roms.size(), ifstream_ns, mapped_ns, pack_ns, machine_ns, open_ns);
+}
+
+// Emulation speed and state hash cost, to compare builds with CHIP8_STATE_HASH on and off: plain runs pay for
+// keeping the hash up to date, GetStateHash gets cheaper, search style runs hash after every frame.
+void BenchRun(char const* rom) {
+    const int FRAMES = 6000;
+    const int CYCLES_PER_FRAME = 1000;
+
+    std::unique_ptr<chip8> start(new chip8);
+    start->Initialize();
+    start->SetSeed(1);
+    start->LoadGame(rom);
+    MachineSetup setup;
+    ResolveMachine(start->GetRomSha1(), nullptr, 0, setup);
+    setup.quirks.display_wait = false; // Would idle most of every frame after its first DXYN.
+    start->SetQuirks(setup.quirks);
+    start->SetCyclesPerSecond(CYCLES_PER_FRAME * 60);
+
+    std::unique_ptr<chip8> machine(new chip8(*start));
+    uint64_t cycles = 0;
+    double run_ns = NsPerCall(1, [&]() {
+        *machine = *start;
+        machine->RunFrames(FRAMES, 0, 0);
+        cycles = machine->GetCycleCount() - start->GetCycleCount();
+    });
+
+    uint64_t sink = 0;
+    double hash_ns = NsPerCall(100000, [&]() { sink += machine->GetStateHash(); });
+    double hashed_run_ns = NsPerCall(1, [&]() {
+        *machine = *start;
+        for (int frame = 0; frame < FRAMES; ++frame) {
+            machine->RunFrames(1, 0, 0);
+            sink += machine->GetStateHash();
+        }
+    });
+    Consume(&sink);
+
+#ifdef CHIP8_STATE_HASH
+    char const* build = "incremental";
+#else
+    char const* build = "full";
+#endif
+    printf("run state hash %s: %.1f MIPS, GetStateHash %.0f ns, hashing every frame %.1f MIPS\n", build,
+           cycles / run_ns * 1e3, hash_ns, cycles / hashed_run_ns * 1e3);
+}
+
+// RAM search filters over 4 KB and 64 KB memories, for one instance and for 64 input branches. Unchanged keeps
+// every candidate, so each call compares the whole memory.
+void BenchRamSearch() {
+    printf("ramsearch kernels %s\n", SimdLevelName(GetSimdLevel()));
+    for (size_t size : { 4096, 65536 }) {
+        for (size_t instances : { 1, 64 }) {
+            std::vector<std::vector<unsigned char>> memories(instances, std::vector<unsigned char>(size));
+            std::vector<unsigned char const*> pointers;
+            for (size_t i = 0; i < instances; ++i) {
+                for (size_t address = 0; address < size; ++address)
+                    memories[i][address] = static_cast<unsigned char>(address * 31 + i);
+                pointers.push_back(memories[i].data());
+            }
+
+            RamSearch search;
+            search.Start(pointers, size);
+            int calls = std::max<int>(10, static_cast<int>(200000000 / (size * instances)));
+            double ns = NsPerCall(calls, [&]() { search.Filter(pointers, RamRelation::Unchanged); });
+            printf("  %5zu bytes x %2zu instances: %9.0f ns per filter, %5.2f GB/s\n", size, instances, ns,
+                   size * instances / ns);
+        }
+    }
+}
+
+}
+
+// Micro benchmarks for the core's hot paths. Each prints its numbers on stdout, see README.md for the runs to compare.
+int main(int argc, char **argv) {
+    if (argc == 2 && strcmp(argv[1], "expand") == 0) {
+        BenchExpand();
+        return 0;
+    }
+
+    if (argc == 2 && strcmp(argv[1], "ramsearch") == 0) {
+        BenchRamSearch();
+        return 0;
+    }
+
+    if (argc == 3 && strcmp(argv[1], "input") == 0) {
+        BenchInput(argv[2]);
+        return 0;
+    }
+
+    if (argc == 3 && strcmp(argv[1], "load") == 0) {
+        BenchLoad(argv[2]);
+        return 0;
+    }
+
+    if (argc == 3 && strcmp(argv[1], "run") == 0) {
+        BenchRun(argv[2]);
+        return 0;
+    }
+
+    std::cerr << "Usage: " << argv[0] << " expand\n"
+              << "       " << argv[0] << " ramsearch\n"
+              << "       " << argv[0] << " input <ROM>\n"
+              << "       " << argv[0] << " load <ROM directory>\n"
+              << "       " << argv[0] << " run <ROM>\n";
+    return 1;
+}
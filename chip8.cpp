@@ -1,12 +1,38 @@
 #include "chip8.h"
+#include "rom_hash.h"
+#include <algorithm>
+#include <cstdio>
 #include <cstdlib>
 #include <ctime>
-#include <fstream>
 #include <cstring>
+#include <fstream>
+#include <memory>
 
 chip8::chip8() {
 }
 
+Quirks QuirksFor(Machine machine) {
+    Quirks quirks;
+    switch (machine) {
+        case Machine::Chip8:
+            quirks.display_wait = true;
+        break;
+
+        case Machine::SuperChip:
+            quirks.vf_reset = false;
+            quirks.shift_vx = true;
+            quirks.memory_leave_i = true;
+            quirks.jump_vx = true;
+        break;
+
+        case Machine::XOChip:
+            quirks.vf_reset = false;
+            quirks.wrap = true;
+        break;
+    }
+    return quirks;
+}
+
 void chip8::Initialize() {
     // Initializes registers and memory one time.
     pc = 0x200; // Program counter starts at 0x200.
@@ -18,11 +44,24 @@ void chip8::Initialize() {
     memset(memory, 0, sizeof(memory));
     memset(V, 0, sizeof(V));
     memset(gfx, 0, sizeof(gfx));
+    memory_hash = 0; // Zero bytes and blank rows don't contribute.
+    gfx_hash = 0;
     memset(stack, 0, sizeof(stack));
-    memset(key, 0, sizeof(key));
+    keypad.Set(0);
+    waiting_key = -1;
+    memset(rpl, 0, sizeof(rpl));
+    memset(audio_pattern, 0, sizeof(audio_pattern));
+    hires = false;
+    plane_mask = 1;
+    pitch = 64;
     draw_flag = true;
+    vblank = false;
+    cycle_count = 0;
+    frame_left = 0;
+    frame_remainder = 0;
+    status = Status::Running;
 
-    // Load fontset from 0-80.
+    // Load fontset at 0x50, where FX29 points.
     unsigned char chip8_fontset[80] = {
         0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
         0x20, 0x60, 0x20, 0x20, 0x70, // 1
@@ -42,53 +81,125 @@ void chip8::Initialize() {
         0xF0, 0x80, 0xF0, 0x80, 0x80  // F
     };
     for (int i = 0; i < 80; ++i)
-        memory[i] = chip8_fontset[i];
+        WriteMemory(0x50 + i, chip8_fontset[i]);
+
+    // SUPER-CHIP 8x10 font at 0xA0, used by FX30.
+    unsigned char big_fontset[160] = {
+        0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+        0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+        0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+        0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+        0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+        0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+        0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+        0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+    };
+    for (int i = 0; i < 160; ++i)
+        WriteMemory(0xA0 + i, big_fontset[i]);
 
     // Set random seed.
-    srand(time(0));
+    SetSeed(time(0));
+
+    // Nothing to reset to until SaveBaseline.
+    baseline.reset();
+    memset(dirty_pages, 0, sizeof(dirty_pages));
 }
 
-void chip8::LoadGame(char const* filename) {
-    // Open the file as a stream of binary.
-    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+// Remembers the current machine, usually right after LoadGame, as the state Reset returns to.
+void chip8::SaveBaseline() {
+    baseline.reset();
+    baseline = std::make_shared<chip8>(*this);
+    memset(dirty_pages, 0, sizeof(dirty_pages));
+}
 
-    if (!file.is_open()) {
-        std::cerr << "Failed to open ROM file.\n";
-        exit(1);
+// Puts the machine back to the baseline. Only memory pages written since then are copied back.
+void chip8::Reset() {
+    if (!baseline) {
+        Initialize();
+        return;
     }
 
-    // Get size of file
-    std::streampos size = file.tellg();
+    chip8 const& base = *baseline;
+    for (int word = 0; word < DIRTY_WORDS; ++word) {
+        uint64_t bits = dirty_pages[word];
+        while (bits) {
+            int page = word * 64 + __builtin_ctzll(bits);
+            memcpy(memory + page * PAGE_SIZE, base.memory + page * PAGE_SIZE, PAGE_SIZE);
+            bits &= bits - 1;
+        }
+        dirty_pages[word] = 0;
+    }
+
+    // Register file and display.
+    opcode = base.opcode;
+    memcpy(V, base.V, sizeof(V));
+    I = base.I;
+    pc = base.pc;
+    memcpy(gfx, base.gfx, sizeof(gfx));
+    memory_hash = base.memory_hash; // Memory and display match the baseline again, so do their hashes.
+    gfx_hash = base.gfx_hash;
+    hires = base.hires;
+    memcpy(rpl, base.rpl, sizeof(rpl));
+    plane_mask = base.plane_mask;
+    memcpy(audio_pattern, base.audio_pattern, sizeof(audio_pattern));
+    pitch = base.pitch;
+    delay_timer = base.delay_timer;
+    sound_timer = base.sound_timer;
+    memcpy(stack, base.stack, sizeof(stack));
+    sp = base.sp;
+    keypad = base.keypad;
+    waiting_key = base.waiting_key;
+    draw_flag = true;
+    vblank = base.vblank;
+    cycle_count = base.cycle_count;
+    frame_left = base.frame_left;
+    frame_remainder = base.frame_remainder;
+    rng_state = base.rng_state;
+    status = base.status;
+}
+
+void chip8::SetSeed(uint64_t seed) {
+    rng_state = seed ? seed : 0x9E3779B97F4A7C15ULL; // xorshift can't leave zero.
+}
+
+// xorshift64*, owned by the machine so resets and replays get the same numbers.
+unsigned char chip8::NextRandom() {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return static_cast<unsigned char>((rng_state * 0x2545F4914F6CDD1DULL) >> 56);
+}
+
+void chip8::LoadGame(char const* filename) {
+    // A plain read: for one small file it beats mapping it, see CHIP8-Bench load. ROM packs are mapped instead.
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    std::streamoff size = file ? static_cast<std::streamoff>(file.tellg()) : 0;
 
-    // Exit if rom is empty or invalid.
     if (size <= 0) {
-        std::cerr << "ROM is empty or invalid.\n";
-        file.close();
+        std::cerr << "Failed to open ROM file, or it is empty.\n";
         exit(1);
     }
 
-    // Check if rom is too large for memory.
-    if (size > (4096 - 0x200)) {
+    if (size > static_cast<std::streamoff>(sizeof(memory) - 0x200)) {
         std::cerr << "ROM is too large to fit in memory.\n";
-        file.close();
         exit(1);
     }
 
-    // Allocate buffer to hold the contents.
-    char* buffer = new char[static_cast<size_t>(size)];
-
-    // Fill buffer with file.
-    file.seekg(0, std::ios::beg);
-    file.read(buffer, size);
-    file.close();
-
-    // Load Game into memory.
-    for (long i = 0; i < size; ++i) {
-        memory[0x200 + i] = buffer[i];
+    std::unique_ptr<unsigned char[]> data(new unsigned char[static_cast<size_t>(size)]);
+    file.seekg(0);
+    if (!file.read(reinterpret_cast<char*>(data.get()), size)) {
+        std::cerr << "Failed to read ROM file.\n";
+        exit(1);
     }
-
-    // Free the buffer.
-    delete[] buffer;
+    LoadGame(data.get(), static_cast<size_t>(size));
 
     // Debug: Print first 10 bytes of loaded ROM
     // std::cout << "ROM loaded successfully. First 10 bytes:\n";
@@ -96,11 +207,30 @@ void chip8::LoadGame(char const* filename) {
     //    printf("0x%04X: 0x%02X\n", i, memory[i]);
 }
 
+// Loads a ROM image that is already in memory, e.g. from a mapped ROM pack.
+bool chip8::LoadGame(unsigned char const* data, size_t size) {
+    if (size == 0 || size > sizeof(memory) - 0x200)
+        return false;
+
+    FlipMemoryHash(0x200, size);
+    memcpy(memory + 0x200, data, size);
+    FlipMemoryHash(0x200, size);
+    MarkDirty(0x200, size);
+
+    // Identify the ROM for the database, ROM packs and caches.
+    rom_hash = HashRom(data, size);
+    Sha1Rom(data, size, rom_sha1);
+    return true;
+}
+
 
 // One emulation cycle.
 void chip8::EmulateCycle() {
+    if (status != Status::Running)
+        return;
+
     // Fetch opcode.
-    opcode = memory[pc] << 8 | memory[pc + 1];
+    opcode = ReadMemory(pc) << 8 | ReadMemory(pc + 1);
 
     // So we don't have to keep repeating the same code.
     pc += 2;
@@ -108,19 +238,87 @@ void chip8::EmulateCycle() {
     // Decode opcode.
     switch (opcode & 0xF000) {
         case 0x0000:
-            switch (opcode & 0x000F) {
-                case 0x0000: // 00E0
-                    memset(gfx, 0, sizeof(gfx));
+            switch (opcode & 0x00FF) {
+                case 0x00E0: // 00E0, clears the selected planes.
+                    for (int plane = 0; plane < 2; ++plane)
+                        if (plane_mask & (1 << plane)) {
+                            FlipPlaneHash(plane);
+                            memset(gfx[plane], 0, sizeof(gfx[plane]));
+                        }
                     draw_flag = true;
                 break;
                 
-                case 0x000E: // 00EE
+                case 0x00EE: // 00EE
+                    if (sp == 0) {
+                        status = Status::StackUnderflow;
+                        pc -= 2;
+                        break;
+                    }
                     --sp;
                     pc = stack[sp];
                 break;
+
+                case 0x00FB: // 00FB, scroll right 4 pixels.
+                    for (int plane = 0; plane < 2; ++plane)
+                        if (plane_mask & (1 << plane)) {
+                            FlipPlaneHash(plane);
+                            for (int row = 0; row < GetHeight(); ++row)
+                                gfx[plane][row] = (gfx[plane][row] >> 4) & ScreenMask();
+                            FlipPlaneHash(plane);
+                        }
+                    draw_flag = true;
+                break;
+
+                case 0x00FC: // 00FC, scroll left 4 pixels.
+                    for (int plane = 0; plane < 2; ++plane)
+                        if (plane_mask & (1 << plane)) {
+                            FlipPlaneHash(plane);
+                            for (int row = 0; row < GetHeight(); ++row)
+                                gfx[plane][row] = (gfx[plane][row] << 4) & ScreenMask();
+                            FlipPlaneHash(plane);
+                        }
+                    draw_flag = true;
+                break;
+
+                case 0x00FD: // 00FD, exit the interpreter. Spin here forever.
+                    pc -= 2;
+                break;
+
+                case 0x00FE: // 00FE, lores.
+                case 0x00FF: // 00FF, hires.
+                    hires = (opcode & 0x0001) != 0;
+                    memset(gfx, 0, sizeof(gfx));
+                    gfx_hash = 0;
+                    draw_flag = true;
+                break;
                 
                 default:
-                    printf("Unknown opcode [0x0000]: 0x%X\n", opcode);
+                    if ((opcode & 0x00F0) == 0x00C0) { // 00CN, scroll down N pixels.
+                        int n = opcode & 0x000F;
+                        for (int plane = 0; plane < 2; ++plane) {
+                            if (plane_mask & (1 << plane)) {
+                                FlipPlaneHash(plane);
+                                memmove(gfx[plane] + n, gfx[plane], (GetHeight() - n) * sizeof(PackedRow));
+                                memset(gfx[plane], 0, n * sizeof(PackedRow));
+                                FlipPlaneHash(plane);
+                            }
+                        }
+                        draw_flag = true;
+                    }
+                    else if ((opcode & 0x00F0) == 0x00D0) { // 00DN, XO-CHIP scroll up N pixels.
+                        int n = opcode & 0x000F;
+                        for (int plane = 0; plane < 2; ++plane) {
+                            if (plane_mask & (1 << plane)) {
+                                FlipPlaneHash(plane);
+                                memmove(gfx[plane], gfx[plane] + n, (GetHeight() - n) * sizeof(PackedRow));
+                                memset(gfx[plane] + GetHeight() - n, 0, n * sizeof(PackedRow));
+                                FlipPlaneHash(plane);
+                            }
+                        }
+                        draw_flag = true;
+                    }
+                    else
+                        printf("Unknown opcode [0x0000]: 0x%X\n", opcode);
             }
         break;
 
@@ -129,6 +327,11 @@ void chip8::EmulateCycle() {
         break;
 
         case 0x2000: // 2NNN
+            if (sp == 16) {
+                status = Status::StackOverflow;
+                pc -= 2;
+                break;
+            }
             stack[sp] = pc;
             ++sp;
             pc = opcode & 0x0FFF;
@@ -136,17 +339,42 @@ void chip8::EmulateCycle() {
 
         case 0x3000: //3XNN
             if (V[(opcode & 0x0F00) >> 8] == (opcode & 0x00FF))
-                pc += 2;
+                SkipNext();
         break;
 
         case 0x4000: //4XNN
             if (V[(opcode & 0x0F00) >> 8] != (opcode & 0x00FF))
-                pc += 2;
+                SkipNext();
         break;
 
-        case 0x5000: // 5XY0
-            if (V[(opcode & 0x0F00) >> 8] == V[(opcode & 0x00F0) >> 8])
-                pc += 2;
+        case 0x5000:
+            switch (opcode & 0x000F) {
+                case 0x0000: // 5XY0
+                    if (V[(opcode & 0x0F00) >> 8] == V[(opcode & 0x00F0) >> 4])
+                        SkipNext();
+                break;
+
+                case 0x0002: { // 5XY2, save VX to VY at I, in either direction. I is left alone.
+                    int x = (opcode & 0x0F00) >> 8;
+                    int y = (opcode & 0x00F0) >> 4;
+                    int step = x <= y ? 1 : -1;
+                    for (int i = 0; i <= abs(y - x); ++i)
+                        WriteMemory(I + i, V[x + i * step]);
+                }
+                break;
+
+                case 0x0003: { // 5XY3, load VX to VY from I.
+                    int x = (opcode & 0x0F00) >> 8;
+                    int y = (opcode & 0x00F0) >> 4;
+                    int step = x <= y ? 1 : -1;
+                    for (int i = 0; i <= abs(y - x); ++i)
+                        V[x + i * step] = ReadMemory(I + i);
+                }
+                break;
+
+                default:
+                    printf("Unknown opcode [0x5000]: 0x%X\n", opcode);
+            }
         break;
 
         case 0x6000: // 6XNN
@@ -165,17 +393,20 @@ void chip8::EmulateCycle() {
 
                 case 0x0001: // 8XY1
                     V[(opcode & 0x0F00) >> 8] |= V[(opcode & 0x00F0) >> 4];
-                    V[0xF] = 0; // Reset VF
+                    if (quirks.vf_reset)
+                        V[0xF] = 0; // Reset VF
                 break;
 
                 case 0x0002: // 8XY2
                     V[(opcode & 0x0F00) >> 8] &= V[(opcode & 0x00F0) >> 4];
-                    V[0xF] = 0; // Reset VF
+                    if (quirks.vf_reset)
+                        V[0xF] = 0; // Reset VF
                 break;
 
                 case 0x0003: //8XY3
                     V[(opcode & 0x0F00) >> 8] ^= V[(opcode & 0x00F0) >> 4];
-                    V[0xF] = 0; // Reset VF
+                    if (quirks.vf_reset)
+                        V[0xF] = 0; // Reset VF
                 break;
 
                 case 0x0004: // 8XY4
@@ -194,10 +425,11 @@ void chip8::EmulateCycle() {
                     V[(opcode & 0x0F00) >> 8] -= V[(opcode & 0x00F0) >> 4];
                 break;
 
-                case 0x0006: // 8XY6
-                    V[(opcode & 0x0F00) >> 8] = V[(opcode & 0x00F0) >> 4];
-                    V[(opcode & 0x0F00) >> 8] >>= 1;
-                    V[0xF] = V[((opcode & 0x0F00) >> 8)] & 1;
+                case 0x0006: { // 8XY6
+                    unsigned char value = V[quirks.shift_vx ? (opcode & 0x0F00) >> 8 : (opcode & 0x00F0) >> 4];
+                    V[(opcode & 0x0F00) >> 8] = value >> 1;
+                    V[0xF] = value & 1; // The bit shifted out.
+                }
                 break;
 
                 case 0x0007: // 8XY7
@@ -208,10 +440,11 @@ void chip8::EmulateCycle() {
                     V[(opcode & 0x0F00) >> 8] = V[(opcode & 0x00F0) >> 4] - V[(opcode & 0x0F00) >> 8];
                 break;
 
-                case 0x000E: // 8XYE
-                    V[(opcode & 0x0F00) >> 8] = V[(opcode & 0x00F0) >> 4];
-                    V[(opcode & 0x0F00) >> 8] <<= 1;
-                    V[0xF] = (V[(opcode & 0x0F00) >> 8] >> 7) & 1;
+                case 0x000E: { // 8XYE
+                    unsigned char value = V[quirks.shift_vx ? (opcode & 0x0F00) >> 8 : (opcode & 0x00F0) >> 4];
+                    V[(opcode & 0x0F00) >> 8] = value << 1;
+                    V[0xF] = value >> 7; // The bit shifted out.
+                }
                 break;
 
                 default:
@@ -221,7 +454,7 @@ void chip8::EmulateCycle() {
 
         case 0x9000: //9XY0
             if (V[(opcode & 0x0F00) >> 8] != V[(opcode & 0x00F0) >> 4])
-                pc += 2;
+                SkipNext();
         break;
 
         case 0xA000: // ANNN
@@ -229,43 +462,67 @@ void chip8::EmulateCycle() {
         break;
 
         case 0xB000: // BNNN
-            pc = V[0] + (opcode & 0x0FFF);
+            if (quirks.jump_vx)
+                pc = V[(opcode & 0x0F00) >> 8] + (opcode & 0x0FFF);
+            else
+                pc = V[0] + (opcode & 0x0FFF);
         break;
 
         case 0xC000: // CXNN
-            V[(opcode & 0x0F00) >> 8] = (rand() % (255 + 0)) & (opcode & 0x00FF);
+            V[(opcode & 0x0F00) >> 8] = NextRandom() & (opcode & 0x00FF);
         break;
 
-        case 0xD000: {// DXYN
-            uint8_t x = V[(opcode & 0x0F00) >> 8] % 64;
-            uint8_t y = V[(opcode & 0x00F0) >> 4] % 32;
-            uint8_t height = opcode & 0x000F;
-            uint8_t pixel;
-            V[0xF] = 0;
+        case 0xD000: {// DXYN, DXY0 draws a 16x16 sprite.
+            if (quirks.display_wait) {
+                if (!vblank) {
+                    pc -= 2; // Wait for the vertical blank.
+                    break;
+                }
+                vblank = false;
+            }
 
-            for (int yline = 0; yline < height; yline++) {
-                pixel = memory[I + yline];
-                for (int xline = 0; xline < 8; xline++) {
-                    if ((pixel & (0x80 >> xline))) {
-                        // Wrap coordinates using modulo.
-                        uint8_t x_pixel = (x + xline);
-                        uint8_t y_pixel = (y + yline);
+            int x = V[(opcode & 0x0F00) >> 8] % GetWidth();
+            int y = V[(opcode & 0x00F0) >> 4] % GetHeight();
+            int height = opcode & 0x000F;
+            int sprite_width = 8;
+            if (height == 0) {
+                height = 16;
+                sprite_width = 16;
+            }
+            V[0xF] = 0;
 
-                        // Calculate position with row offset.
-                        uint16_t pos = x_pixel + (y_pixel * 64);
+            // Every selected plane takes its own sprite data, one after the other starting at I.
+            unsigned short address = I;
+            for (int plane = 0; plane < 2; ++plane) {
+                if (!(plane_mask & (1 << plane)))
+                    continue;
+
+                // Each sprite line becomes one 128-bit mask, clipped or wrapped at the screen edges.
+                for (int yline = 0; yline < height; yline++) {
+                    int row = y + yline;
+                    if (row >= GetHeight()) {
+                        if (!quirks.wrap)
+                            break;
+                        row -= GetHeight();
+                    }
 
-                        // Check collision before modifying.
-                        if (gfx[pos] == 1)
-                            V[0xF] = 1;
+                    unsigned int pixels = sprite_width == 16
+                        ? ReadMemory(address + yline * 2) << 8 | ReadMemory(address + yline * 2 + 1)
+                        : ReadMemory(address + yline);
+                    PackedRow sprite = PackedRow(pixels) << (128 - sprite_width);
+                    PackedRow line = sprite >> x;
+                    if (quirks.wrap && x > 0)
+                        line |= sprite << (GetWidth() - x); // Pixels past the right edge come back on the left.
+                    line &= ScreenMask();
+
+                    // Check collision before modifying.
+                    if (gfx[plane][row] & line)
+                        V[0xF] = 1;
 
-                        // XOR the pixel.
-                        gfx[pos] ^= 1;
-                    }
-                    if (x + 1 >= 64)
-                        break;
+                    // XOR the pixels.
+                    XorRow(plane, row, line);
                 }
-                if (y + 1 >= 32)
-                    break;
+                address += height * sprite_width / 8;
             }
         }
         draw_flag = true;
@@ -274,13 +531,15 @@ void chip8::EmulateCycle() {
         case 0xE000:
             switch (opcode & 0x00FF) {
                 case 0x009E: // EX9E
-                    if (key[V[(opcode & 0x0F00) >> 8]] != 0)
-                        pc += 2;
+                    PollInput();
+                    if (keypad.Pressed(V[(opcode & 0x0F00) >> 8]))
+                        SkipNext();
                 break;
 
                 case 0x00A1: // EXA1
-                    if (key[V[(opcode & 0x0F00) >> 8]] == 0)
-                        pc += 2;
+                    PollInput();
+                    if (!keypad.Pressed(V[(opcode & 0x0F00) >> 8]))
+                        SkipNext();
                 break;
 
                 default:
@@ -290,21 +549,36 @@ void chip8::EmulateCycle() {
 
         case 0xF000:
             switch (opcode & 0x00FF) {
+                case 0x0000: // F000 NNNN, XO-CHIP long I load.
+                    I = ReadMemory(pc) << 8 | ReadMemory(pc + 1);
+                    pc += 2;
+                break;
+
+                case 0x0001: // FN01, XO-CHIP plane select.
+                    plane_mask = (opcode & 0x0F00) >> 8 & 0x3;
+                break;
+
+                case 0x0002: // F002, XO-CHIP audio pattern. Stored for when there is sound.
+                    for (int i = 0; i < 16; ++i)
+                        audio_pattern[i] = ReadMemory(I + i);
+                break;
+
                 case 0x0007: // FX07
                     V[(opcode & 0x0F00) >> 8] = delay_timer;
                 break;
 
                 case 0x000A: {// FX0A
-                    bool key_pressed = false;
-                    for (int i = 0; i < 16; ++i) {
-                        if (key[i]) {
-                            V[(opcode & 0x0F00) >> 8] = i;
-                            key_pressed = true;
-                            break;
-                        }
+                    // Like the COSMAC VIP, wait for a key to go down and then come back up.
+                    PollInput();
+                    uint16_t keys = keypad.Get();
+                    if (waiting_key < 0 && keys)
+                        waiting_key = static_cast<int8_t>(__builtin_ctz(keys));
+                    if (waiting_key >= 0 && !(keys >> waiting_key & 1)) {
+                        V[(opcode & 0x0F00) >> 8] = static_cast<unsigned char>(waiting_key);
+                        waiting_key = -1;
                     }
-                    if (!key_pressed)
-                        pc -= 2; // If no key is pressed, do this instruction
+                    else
+                        pc -= 2; // Until then, do this instruction again.
                 }
                 break;
 
@@ -320,26 +594,46 @@ void chip8::EmulateCycle() {
                     I += V[(opcode & 0x0F00) >> 8];
                 break;
 
+                case 0x003A: // FX3A, XO-CHIP audio pitch.
+                    pitch = V[(opcode & 0x0F00) >> 8];
+                break;
+
                 case 0x0029: // FX29
-                    I = 0x50 + (5 * V[(opcode & 0x0F00) >> 8]);
+                    I = 0x50 + (5 * (V[(opcode & 0x0F00) >> 8] & 0xF));
+                break;
+
+                case 0x0030: // FX30
+                    I = 0xA0 + (10 * (V[(opcode & 0x0F00) >> 8] & 0xF));
                 break;
 
                 case 0x0033: // FX33
-                    memory[I] = V[(opcode & 0x0F00) >> 8] / 100;
-                    memory[I + 1] = (V[(opcode & 0x0F00) >> 8] / 10) % 10;
-                    memory[I + 2] = (V[(opcode & 0x0F00) >> 8] % 100) % 10;
+                    WriteMemory(I, V[(opcode & 0x0F00) >> 8] / 100);
+                    WriteMemory(I + 1, (V[(opcode & 0x0F00) >> 8] / 10) % 10);
+                    WriteMemory(I + 2, (V[(opcode & 0x0F00) >> 8] % 100) % 10);
                 break;
 
                 case 0x0055: // FX55
                     for (unsigned char i = 0; i <= ((opcode & 0x0F00) >> 8); ++i)
-                        memory[I + i] = V[i];
-                    I += ((opcode & 0x0F00) >> 8) + 1;
+                        WriteMemory(I + i, V[i]);
+                    if (!quirks.memory_leave_i)
+                        I += ((opcode & 0x0F00) >> 8) + 1;
                 break;
 
                 case 0x0065: // FX65
                     for (unsigned char i = 0; i <= ((opcode & 0x0F00) >> 8); ++i)
-                        V[i] = memory[I + i];
-                    I += ((opcode & 0x0F00) >> 8) + 1;
+                        V[i] = ReadMemory(I + i);
+                    if (!quirks.memory_leave_i)
+                        I += ((opcode & 0x0F00) >> 8) + 1;
+                break;
+
+                case 0x0075: // FX75
+                    for (unsigned char i = 0; i <= ((opcode & 0x0F00) >> 8); ++i)
+                        rpl[i] = V[i];
+                break;
+
+                case 0x0085: // FX85
+                    for (unsigned char i = 0; i <= ((opcode & 0x0F00) >> 8); ++i)
+                        V[i] = rpl[i];
                 break;
 
                 default:
@@ -351,19 +645,236 @@ void chip8::EmulateCycle() {
             printf("Unknown opcode: 0x%X\n", opcode);
     }
 
+    ++cycle_count;
+
     // For debugging.
     // printf("Executing opcode: 0x%04X at PC: 0x%04X\n", opcode, pc-2);
 }
 
-unsigned char* chip8::GetGFX() {
-    return gfx;
+// Frames are cut from the cycle budget the way a 60Hz frontend does it: cycles_per_second / 60 each,
+// with the fraction carried over. Below 60 cycles per second a frame would be empty, so that is the minimum.
+// A cycle accurate build always runs at its machine's speed.
+void chip8::SetCyclesPerSecond(int new_cycles_per_second) {
+    if (Timing::CYCLE_ACCURATE && new_cycles_per_second > 0)
+        new_cycles_per_second = Timing::FRAME_CYCLES * 60;
+    cycles_per_second = new_cycles_per_second > 0 ? std::max(new_cycles_per_second, 60) : 0;
+}
+
+// Cycles until the timers have ticked frames more times.
+int chip8::GetFrameCycles(int frames) {
+    if (!cycles_per_second)
+        return 0;
+
+    int count = 0;
+    int left = frame_left;
+    int remainder = frame_remainder;
+    for (int frame = 0; frame < frames; ++frame) {
+        if (left <= 0) {
+            remainder += cycles_per_second;
+            left += remainder / 60;
+            remainder %= 60;
+        }
+        count += std::max(left, 0);
+        left = 0;
+    }
+    return count;
+}
+
+// Runs a batch of cycles covering host time [start_time, end_time), returns how many it used.
+// Queued key events are spread over the batch by their timestamp, so a tap shorter than one batch still lands.
+// With SetCyclesPerSecond the timers tick at every frame end inside the batch, so a batch can span many frames.
+int chip8::RunCycles(int count, uint64_t start_time, uint64_t end_time) {
+    uint64_t span = end_time > start_time ? end_time - start_time : 0;
+    input_polled = false;
+
+    // Each pass runs to the end of the batch or of the current frame, whichever comes first.
+    int i = 0;
+    while (i < count) {
+        if (cycles_per_second && frame_left <= 0) {
+            frame_remainder += cycles_per_second;
+            frame_left += frame_remainder / 60;
+            frame_remainder %= 60;
+        }
+
+        int first = i;
+        int stop = cycles_per_second ? std::min(count, i + frame_left) : count;
+        bool stopped = false;
+        while (i < stop) {
+            // A fault stops the machine where it is.
+            if (status != Status::Running) {
+                stopped = true;
+                break;
+            }
+
+            // DXYN is stalled until the next interrupt, nothing else can happen this frame.
+            // With the timers in here the rest of the frame passes idle, else the host has to tick them first.
+            if (quirks.display_wait && !vblank && (memory[pc] & 0xF0) == 0xD0) {
+                stopped = !cycles_per_second;
+                if (!stopped)
+                    i = stop;
+                break;
+            }
+
+            pressed_this_cycle = 0;
+            ApplyInput(start_time + span * (i + 1) / count);
+            i += GetInstructionCycles();
+            EmulateCycle();
+        }
+
+        if (cycles_per_second) {
+            frame_left -= i - first;
+            if (frame_left <= 0)
+                UpdateTimers();
+        }
+        if (stopped)
+            break;
+    }
+    return i;
+}
+
+// Applies queued key events stamped before due_time.
+void chip8::ApplyInput(uint64_t due_time) {
+    while (input_queue) {
+        KeyEvent const* event = input_queue->Peek();
+        if (!event || event->timestamp >= due_time)
+            break;
+
+        // Hold a key for at least one instruction before releasing it.
+        uint16_t bit = 1 << (event->key & 0xF);
+        if (!event->pressed && (pressed_this_cycle & bit))
+            break;
+        if (event->pressed)
+            pressed_this_cycle |= bit;
+
+        KeyEvent applied = *event;
+        keypad.Press(applied.key, applied.pressed);
+        input_queue->Pop();
+        if (key_listener)
+            key_listener(applied);
+    }
+}
+
+// Called by the first key read of a batch. Lets the frontend poll the host right now instead of at the start of the frame.
+void chip8::PollInput() {
+    if (input_polled || !input_hook)
+        return;
+
+    input_polled = true;
+    input_hook();
+    ApplyInput(UINT64_MAX);
+}
+
+// Hash of everything the ROM can observe. Host bookkeeping like the draw flag and cycle count is left out,
+// so engines that count stalled cycles differently still agree.
+// Memory and display hashes are kept up to date on every write, the rest is under 100 bytes and hashed here.
+uint64_t chip8::GetStateHash() {
+#ifdef CHIP8_STATE_HASH
+    uint64_t hash = memory_hash ^ gfx_hash;
+#else
+    uint64_t hash = HashRom(memory, sizeof(memory)) ^ HashRom(reinterpret_cast<unsigned char const*>(gfx), sizeof(gfx));
+#endif
+    auto mix = [&](void const* data, size_t size) {
+        hash = (hash ^ HashRom(static_cast<unsigned char const*>(data), size)) * 0x100000001B3ULL;
+    };
+
+    mix(V, sizeof(V));
+    mix(&I, sizeof(I));
+    mix(&pc, sizeof(pc));
+    mix(&plane_mask, sizeof(plane_mask));
+    mix(audio_pattern, sizeof(audio_pattern));
+    mix(&pitch, sizeof(pitch));
+    mix(&hires, sizeof(hires));
+    mix(rpl, sizeof(rpl));
+    mix(&delay_timer, sizeof(delay_timer));
+    mix(&sound_timer, sizeof(sound_timer));
+    mix(stack, sizeof(stack));
+    mix(&sp, sizeof(sp));
+    uint16_t keys = keypad.Get();
+    mix(&keys, sizeof(keys));
+    mix(&waiting_key, sizeof(waiting_key));
+    mix(&vblank, sizeof(vblank));
+    mix(&frame_left, sizeof(frame_left));
+    mix(&frame_remainder, sizeof(frame_remainder));
+    mix(&rng_state, sizeof(rng_state));
+    mix(&status, sizeof(status));
+    return hash;
+}
+
+// Registers, stack and timers, for divergence and crash reports.
+void chip8::PrintState(std::ostream& out) {
+    char line[128];
+    snprintf(line, sizeof(line), "pc %04X  I %04X  sp %d  dt %02X  st %02X  status %d  cycle %llu\n",
+             pc, I, sp, delay_timer, sound_timer, static_cast<int>(status), static_cast<unsigned long long>(cycle_count));
+    out << line;
+
+    for (int i = 0; i < 16; ++i) {
+        snprintf(line, sizeof(line), "V%X %02X%s", i, V[i], i % 8 == 7 ? "\n" : "  ");
+        out << line;
+    }
+
+    out << "keys ";
+    for (int i = 0; i < 16; ++i)
+        out << (keypad.Pressed(i) ? "0123456789ABCDEF"[i] : '.');
+
+    out << "\nstack";
+    for (int i = 0; i < sp && i < 16; ++i) {
+        snprintf(line, sizeof(line), " %04X", stack[i]);
+        out << line;
+    }
+    out << "\n";
+}
+
+PackedRow const* chip8::GetGFX() {
+    return gfx[0];
 }
 
+// Palette index of pixel num in the current resolution, row major.
 int chip8::GetGFX(int num) {
-    return gfx[num];
+    int bit = 127 - num % GetWidth();
+    PackedRow const* rows = gfx[0] + num / GetWidth();
+    return static_cast<int>(rows[0] >> bit & 1) | static_cast<int>(rows[64] >> bit & 1) << 1;
+}
+
+#ifdef CHIP8_STATE_HASH
+// Keys are a 64-bit mix of what and where, so a byte or row moving changes the hash too.
+uint64_t chip8::MixKey(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    return x ^ x >> 31;
+}
+
+uint64_t chip8::RowKey(int plane, int row, PackedRow value) {
+    if (!value)
+        return 0;
+    uint64_t high = static_cast<uint64_t>(value >> 64) * 0x9E3779B97F4A7C15ULL;
+    return MixKey(static_cast<uint64_t>(value) ^ (high << 32 | high >> 32) ^ (plane * 64 + row + 1) * 0xD6E8FEB86659FD93ULL);
+}
+
+void chip8::FlipMemoryHash(size_t address, size_t size) {
+    for (size_t i = address; i < address + size; ++i)
+        memory_hash ^= ByteKey(i, memory[i]);
+}
+
+void chip8::FlipPlaneHash(int plane) {
+    for (int row = 0; row < 64; ++row)
+        gfx_hash ^= RowKey(plane, row, gfx[plane][row]);
+}
+#endif
+
+void chip8::MarkDirty(size_t address, size_t size) {
+    for (size_t page = address / PAGE_SIZE; page <= (address + size - 1) / PAGE_SIZE; ++page)
+        dirty_pages[page / 64] |= 1ULL << (page % 64);
+}
+
+// Skips the next instruction, which is 4 bytes long if it is F000 NNNN.
+void chip8::SkipNext() {
+    pc += (ReadMemory(pc) << 8 | ReadMemory(pc + 1)) == 0xF000 ? 4 : 2;
 }
 
 void chip8::UpdateTimers() {
+    vblank = true;
     if (delay_timer > 0) 
         --delay_timer;
     if (sound_timer > 0) {
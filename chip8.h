@@ -3,34 +3,156 @@
 
 #include <string>
 #include <iostream>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include "input_queue.h"
+#include "keypad.h"
+#include "pixel_expand.h"
+#include "vip_timing.h"
+
+// Behaviours that differ between CHIP-8 implementations. Defaults are the original COSMAC VIP ones.
+struct Quirks {
+    bool display_wait = false; // DXYN waits for the vertical blank, like the COSMAC VIP. At most one sprite per frame.
+    bool vf_reset = true; // 8XY1, 8XY2 and 8XY3 clear VF.
+    bool shift_vx = false; // 8XY6 and 8XYE shift VX in place instead of copying VY first.
+    bool memory_leave_i = false; // FX55 and FX65 leave I unchanged.
+    bool jump_vx = false; // BXNN jumps to XNN + VX instead of NNN + V0.
+    bool wrap = false; // Sprites wrap around the screen edges instead of being clipped.
+};
+
+enum class Machine : uint8_t { Chip8, SuperChip, XOChip };
+
+// Why the machine stopped, if it did. EmulateCycle does nothing once this leaves Running.
+enum class Status : uint8_t { Running, StackOverflow, StackUnderflow, Halted };
+
+Quirks QuirksFor(Machine machine);
 
 class chip8 {
 public:
     chip8(); // Constructor
     void Initialize();
+    void SaveBaseline();
+    void Reset();
+    void SetSeed(uint64_t seed);
     void LoadGame(char const* filename);
+    bool LoadGame(unsigned char const* data, size_t size);
+    uint64_t GetRomHash() { return rom_hash; }
+    unsigned char const* GetRomSha1() { return rom_sha1; }
     void EmulateCycle();
-    unsigned char* GetGFX();
+    int RunCycles(int count, uint64_t start_time, uint64_t end_time);
+    void SetCyclesPerSecond(int cycles_per_second);
+    int GetFrameCycles(int frames);
+    void RunFrames(int frames, uint64_t start_time, uint64_t end_time) { RunCycles(GetFrameCycles(frames), start_time, end_time); }
+    void SetInputQueue(KeyEventQueue* queue) { input_queue = queue; }
+    void SetInputHook(std::function<void()> hook) { input_hook = hook; }
+    void SetKeyListener(std::function<void(KeyEvent const&)> listener) { key_listener = listener; } // Called after a queued key event changes the keypad.
+    bool GetInputPolled() { return input_polled; }
+    uint64_t GetCycleCount() { return cycle_count; }
+    Status GetStatus() { return status; }
+    void Halt() { status = Status::Halted; } // The frontend found the ROM looping forever.
+    bool GetTimersIdle() { return delay_timer == 0 && sound_timer == 0; }
+    unsigned short GetPC() { return pc; }
+    // Cycles the next instruction takes, always 1 unless built with CHIP8_VIP_TIMING.
+    int GetInstructionCycles() {
+        if constexpr (Timing::CYCLE_ACCURATE) {
+            uint16_t next = memory[pc] << 8 | memory[(pc + 1) & 0xFFFF];
+            unsigned char vx = V[next >> 8 & 0xF];
+            return Timing::Cycles(next, vx, V[next >> 4 & 0xF], keypad.Pressed(vx));
+        }
+        return 1;
+    }
+    uint64_t GetStateHash();
+    void PrintState(std::ostream& out);
+    PackedRow const* GetGFX();
+    PackedRow const* GetPlane(int plane) { return gfx[plane & 1]; }
     int GetGFX(int num);
-    void UpdateTimers();
-    unsigned char key[16]; // Hexadecimal keypad.
-    unsigned char GetMemory(int address) { return memory[address]; }
+    int GetWidth() { return hires ? 128 : 64; }
+    int GetHeight() { return hires ? 64 : 32; }
+    void UpdateTimers(); // The 60Hz tick, for hosts that drive the timers themselves.
+    void SetQuirks(Quirks const& new_quirks) { quirks = new_quirks; }
+    Keypad keypad; // Hexadecimal keypad, the frontend may set it from another thread.
+    unsigned char GetMemory(int address) { return memory[address & 0xFFFF]; }
+    unsigned char const* GetMemoryData() { return memory; } // All 64K, for tools that scan memory in bulk.
     bool GetDrawFlag();
     void SetDrawFlag(bool new_value) { draw_flag = new_value; }
     ~chip8(); // Destructor
 
 private:
     unsigned short opcode; // 35 opcodes.
-    unsigned char memory[4096]; // 4K memory in total.
+    unsigned char memory[65536]; // 64K memory for XO-CHIP, CHIP-8 programs only see the first 4K.
     unsigned char V[16]; // 15 8-bit registers, V0, V1, all the way to VF. The 16th register is used for the 'carry flag'.
     unsigned short I; // Index register I.
     unsigned short pc; // Program counter (pc).
-    unsigned char gfx[64 * 32]; // Graphics, 2048 pixels in total.
+    PackedRow gfx[2][64]; // Graphics, two XO-CHIP bitplanes of one 128-bit row per line. Lores only uses the top-left 64x32.
+    unsigned char plane_mask; // Planes touched by drawing, clearing and scrolling.
+    unsigned char audio_pattern[16]; // XO-CHIP sample buffer, F002.
+    unsigned char pitch; // XO-CHIP playback rate, FX3A.
+    bool hires; // SUPER-CHIP 128x64 mode.
+    unsigned char rpl[16]; // SUPER-CHIP RPL user flags, saved by FX75.
     unsigned char delay_timer; // Used for timing the events of the game, it's value can be set and read.
     unsigned char sound_timer; // Used for sound effects, it's value can only be set.
     unsigned short stack[16]; // Used to store return addresses when subroutines are called.
     unsigned short sp; // Stack pointer.
     bool draw_flag;
+    bool vblank; // Set by the 60Hz timer interrupt, consumed by DXYN when display_wait is on.
+    Quirks quirks;
+    int cycles_per_second = 0; // Timers tick from inside RunCycles once per frame of this many cycles / 60. 0 leaves them to the host.
+    int frame_left; // Cycles left until the next timer tick, 0 or less before a frame starts. An overrun is taken off the next frame.
+    int frame_remainder; // Fraction of a cycle carried to the next frame, in 60ths.
+    uint64_t rom_hash = 0; // HashRom of the loaded ROM.
+    unsigned char rom_sha1[20] = {};
+    uint64_t cycle_count; // Instructions executed since Initialize.
+    KeyEventQueue* input_queue = nullptr; // Key transitions waiting for their cycle.
+    std::function<void()> input_hook; // Polls the host for input, called at most once per batch.
+    std::function<void(KeyEvent const&)> key_listener;
+    bool input_polled = false;
+    uint64_t rng_state; // CXNN random numbers.
+    Status status;
+
+    // Reset support: memory is tracked in 64 byte pages written since the baseline.
+    static constexpr int PAGE_SIZE = 64;
+    static constexpr int DIRTY_WORDS = sizeof(memory) / PAGE_SIZE / 64;
+    std::shared_ptr<chip8 const> baseline; // Shared by copies, never changes once saved.
+    uint64_t dirty_pages[DIRTY_WORDS];
+    // Every address computed from I or pc wraps at 64K instead of running off the end of memory.
+    unsigned char ReadMemory(unsigned int address) { return memory[address & 0xFFFF]; }
+    void WriteMemory(unsigned int address, unsigned char value) {
+        address &= 0xFFFF;
+#ifdef CHIP8_STATE_HASH
+        memory_hash ^= ByteKey(address, memory[address]) ^ ByteKey(address, value);
+#endif
+        memory[address] = value;
+        dirty_pages[address / PAGE_SIZE / 64] |= 1ULL << (address / PAGE_SIZE % 64);
+    }
+    void MarkDirty(size_t address, size_t size);
+
+    // Incremental state hash, the XOR of a key per non-zero memory byte and display row.
+    // Writes XOR the old value's key out and the new one's in, bulk changes flip a whole range before and after.
+    uint64_t memory_hash;
+    uint64_t gfx_hash;
+#ifdef CHIP8_STATE_HASH
+    static uint64_t MixKey(uint64_t x);
+    static uint64_t ByteKey(unsigned int address, unsigned char value) { return value ? MixKey(address << 8 | value) : 0; }
+    static uint64_t RowKey(int plane, int row, PackedRow value);
+    void FlipMemoryHash(size_t address, size_t size);
+    void FlipPlaneHash(int plane);
+    void XorRow(int plane, int row, PackedRow line) {
+        gfx_hash ^= RowKey(plane, row, gfx[plane][row]) ^ RowKey(plane, row, gfx[plane][row] ^ line);
+        gfx[plane][row] ^= line;
+    }
+#else
+    void FlipMemoryHash(size_t, size_t) {}
+    void FlipPlaneHash(int) {}
+    void XorRow(int plane, int row, PackedRow line) { gfx[plane][row] ^= line; }
+#endif
+    unsigned char NextRandom();
+    uint16_t pressed_this_cycle = 0;
+    int8_t waiting_key; // Key FX0A saw go down, it completes once the key is released again. -1 while none is down.
+    PackedRow ScreenMask() { return ~PackedRow(0) << (128 - GetWidth()); } // Bits that are on screen in the current mode.
+    void SkipNext();
+    void ApplyInput(uint64_t due_time);
+    void PollInput();
 };
 
 #endif
\ No newline at end of file
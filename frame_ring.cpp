@@ -0,0 +1,146 @@
+#include "frame_ring.h"
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool FrameRing::Create(char const* segment_name, uint32_t instances, uint32_t depth) {
+    Close();
+
+#ifdef _WIN32
+    (void)segment_name;
+    (void)instances;
+    (void)depth;
+    return false; // POSIX shared memory only.
+#else
+    if (instances == 0 || depth == 0 || depth > (UINT32_MAX - sizeof(FrameRingSlot)) / FRAME_SIZE || strlen(segment_name) >= sizeof(name))
+        return false;
+
+    uint32_t slot_size = sizeof(FrameRingSlot) + depth * FRAME_SIZE;
+    size_t total = sizeof(FrameRingHeader) + static_cast<size_t>(slot_size) * instances;
+
+    shm_unlink(segment_name); // A stale segment from a crashed run may have another size.
+    int file = shm_open(segment_name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (file < 0)
+        return false;
+
+    void* view = ftruncate(file, static_cast<off_t>(total)) == 0
+        ? mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0)
+        : MAP_FAILED;
+    close(file);
+    if (view == MAP_FAILED) {
+        shm_unlink(segment_name);
+        return false;
+    }
+
+    // The segment starts zeroed, every sequence is 0 and nothing is published.
+    header = static_cast<FrameRingHeader*>(view);
+    size = total;
+    strcpy(name, segment_name);
+    header->instances = instances;
+    header->depth = depth;
+    header->frame_size = FRAME_SIZE;
+    header->slot_size = slot_size;
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(header->magic, "C8RING1", 8); // Last, so readers never see a half written header as valid.
+    return true;
+#endif
+}
+
+bool FrameRing::Open(char const* segment_name) {
+    Close();
+
+#ifdef _WIN32
+    (void)segment_name;
+    return false;
+#else
+    int file = shm_open(segment_name, O_RDONLY, 0);
+    if (file < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(file, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(FrameRingHeader)) {
+        close(file);
+        return false;
+    }
+
+    void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, file, 0);
+    close(file);
+    if (view == MAP_FAILED)
+        return false;
+
+    header = static_cast<FrameRingHeader*>(view);
+    size = static_cast<size_t>(info.st_size);
+    // A slot has to hold depth frames and keep the next slot's sequence aligned, or reads would divide by zero
+    // or run into the next slot.
+    if (memcmp(header->magic, "C8RING1", 8) != 0 || header->frame_size != FRAME_SIZE || header->depth == 0
+        || header->slot_size < sizeof(FrameRingSlot) + static_cast<uint64_t>(header->depth) * FRAME_SIZE
+        || header->slot_size % alignof(FrameRingSlot) != 0
+        || sizeof(FrameRingHeader) + static_cast<size_t>(header->slot_size) * header->instances > size) {
+        Close();
+        return false;
+    }
+    return true;
+#endif
+}
+
+void FrameRing::Close() {
+    if (!header)
+        return;
+
+#ifndef _WIN32
+    munmap(header, size);
+    if (name[0])
+        shm_unlink(name);
+#endif
+
+    header = nullptr;
+    size = 0;
+    name[0] = 0;
+}
+
+FrameRingSlot* FrameRing::Slot(uint32_t instance) const {
+    unsigned char* base = reinterpret_cast<unsigned char*>(header) + sizeof(FrameRingHeader);
+    return reinterpret_cast<FrameRingSlot*>(base + static_cast<size_t>(header->slot_size) * instance);
+}
+
+unsigned char* FrameRing::FrameData(uint32_t instance, uint64_t index) const {
+    return reinterpret_cast<unsigned char*>(Slot(instance) + 1) + index % header->depth * FRAME_SIZE;
+}
+
+// One writer per instance. Both planes are copied as they are, no conversion on the hot path.
+void FrameRing::Publish(uint32_t instance, PackedRow const* gfx) {
+    FrameRingSlot* slot = Slot(instance);
+    uint64_t sequence = slot->sequence.load(std::memory_order_relaxed);
+    slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    memcpy(FrameData(instance, slot->published), gfx, FRAME_SIZE);
+    ++slot->published;
+
+    slot->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+uint64_t FrameRing::ReadBegin(uint32_t instance) const {
+    FrameRingSlot* slot = Slot(instance);
+    uint64_t sequence;
+    while ((sequence = slot->sequence.load(std::memory_order_acquire)) & 1)
+        ; // A frame is being written, it takes well under a microsecond.
+    return sequence;
+}
+
+bool FrameRing::ReadRetry(uint32_t instance, uint64_t sequence) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return Slot(instance)->sequence.load(std::memory_order_relaxed) != sequence;
+}
+
+PackedRow const* FrameRing::Frame(uint32_t instance, uint32_t age) const {
+    uint64_t published = Slot(instance)->published;
+    if (age >= published || age >= header->depth)
+        return nullptr;
+    return reinterpret_cast<PackedRow const*>(FrameData(instance, published - 1 - age));
+}
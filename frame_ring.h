@@ -0,0 +1,59 @@
+#ifndef FRAME_RING_H
+#define FRAME_RING_H
+
+#include <atomic>
+#include <cstdint>
+#include "pixel_expand.h"
+
+// Last K frames of every instance in a POSIX shared memory segment, for a consumer in another process.
+// Layout: header, then per instance a 64 byte slot header followed by depth frames. A frame is
+// both bitplanes as GetGFX returns them, 2 x 64 rows of 16 bytes, plane 0 first.
+// Each instance is a seqlock: the writer makes the sequence odd while it writes, so a reader that sees
+// the same even sequence before and after reading knows the frames it read straight from the segment are whole.
+struct alignas(64) FrameRingHeader {
+    char magic[8]; // "C8RING1"
+    uint32_t instances;
+    uint32_t depth;
+    uint32_t frame_size;
+    uint32_t slot_size; // Bytes from one instance slot to the next.
+};
+
+struct alignas(64) FrameRingSlot {
+    std::atomic<uint64_t> sequence;
+    uint64_t published; // Frames written so far, the newest is at (published - 1) % depth.
+};
+
+class FrameRing {
+public:
+    static constexpr uint32_t FRAME_SIZE = 2 * 64 * sizeof(PackedRow);
+
+    FrameRing() = default;
+    FrameRing(FrameRing const&) = delete;
+    FrameRing& operator=(FrameRing const&) = delete;
+    ~FrameRing() { Close(); }
+
+    // Writer side, creates or replaces the named segment.
+    bool Create(char const* name, uint32_t instances, uint32_t depth);
+    void Publish(uint32_t instance, PackedRow const* gfx);
+
+    // Reader side.
+    bool Open(char const* name);
+    uint64_t ReadBegin(uint32_t instance) const; // Spins while a write is in progress.
+    bool ReadRetry(uint32_t instance, uint64_t sequence) const; // True if the frames read since ReadBegin may be torn.
+    PackedRow const* Frame(uint32_t instance, uint32_t age) const; // age 0 is the newest frame.
+    uint64_t Published(uint32_t instance) const { return Slot(instance)->published; }
+
+    void Close();
+    uint32_t Instances() const { return header ? header->instances : 0; }
+    uint32_t Depth() const { return header ? header->depth : 0; }
+
+private:
+    FrameRingHeader* header = nullptr;
+    size_t size = 0;
+    char name[64] = {}; // Set when this process created the segment and unlinks it on Close.
+
+    FrameRingSlot* Slot(uint32_t instance) const;
+    unsigned char* FrameData(uint32_t instance, uint64_t index) const;
+};
+
+#endif
@@ -0,0 +1,119 @@
+// libFuzzer entry point for the core.
+//
+// Without CHIP8_FUZZ_ROM the input is a whole test case:
+//   byte 0       machine (low 2 bits, chip8/schip/xochip) and display wait (bit 2)
+//   bytes 1-2    ROM size, little endian
+//   ROM bytes    loaded at 0x200
+//   the rest     key script, pairs of (cycles to wait, key | 0x80 when pressed)
+// With CHIP8_FUZZ_ROM=<file> that ROM is loaded once and the whole input is the key script.
+//
+// Every run starts from a snapshot taken once, Reset only copies back the pages the last run dirtied.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "chip8.h"
+#include "mapped_file.h"
+#include "romdb.h"
+
+namespace {
+
+// The core ticks the timers every frame's worth of cycles, as in the frontends, whatever the key script holds.
+const int CYCLES_PER_FRAME = Timing::CYCLE_ACCURATE ? Timing::FRAME_CYCLES : 10;
+const int MAX_CYCLES = CYCLES_PER_FRAME * 1000;
+
+chip8 machine;
+bool fixed_rom = false;
+
+void Setup() {
+    // Unknown opcodes are reported on stdout, random ROMs hit them every few cycles.
+    if (!std::freopen("/dev/null", "w", stdout))
+        exit(1);
+
+    machine.Initialize();
+    machine.SetSeed(1); // Same numbers every run, so crashes reproduce.
+    machine.SetCyclesPerSecond(CYCLES_PER_FRAME * 60);
+
+    if (char const* rom_file = std::getenv("CHIP8_FUZZ_ROM")) {
+        MappedFile file;
+        if (!file.Open(rom_file) || !machine.LoadGame(file.Data(), file.Size())) {
+            std::cerr << "Failed to load CHIP8_FUZZ_ROM.\n";
+            exit(1);
+        }
+        fixed_rom = true;
+
+        MachineSetup setup;
+        ResolveMachine(machine.GetRomSha1(), nullptr, 0, setup);
+        machine.SetQuirks(setup.quirks);
+    }
+    machine.SaveBaseline();
+}
+
+// Runs the key script, a key event every few cycles, then whatever is left of the cycle budget. Events go
+// through a key event queue like a frontend's, stamped with the cycle they are due on.
+void RunScript(uint8_t const* script, size_t size) {
+    KeyEventQueue queue;
+    machine.SetInputQueue(&queue);
+
+    int cycles = 0;
+    for (size_t i = 0; i + 1 < size && cycles < MAX_CYCLES; i += 2) {
+        int wait = std::min<int>(script[i], MAX_CYCLES - cycles);
+        if (wait && machine.RunCycles(wait, cycles, cycles + wait) < wait)
+            break;
+        cycles += wait;
+        queue.Push({ static_cast<uint64_t>(cycles), static_cast<uint8_t>(script[i + 1] & 0xF), (script[i + 1] & 0x80) != 0 });
+    }
+
+    if (cycles < MAX_CYCLES && machine.GetStatus() == Status::Running)
+        machine.RunCycles(MAX_CYCLES - cycles, cycles, MAX_CYCLES);
+    machine.SetInputQueue(nullptr);
+}
+
+}
+
+extern "C" int LLVMFuzzerTestOneInput(uint8_t const* data, size_t size) {
+    static bool ready = (Setup(), true);
+    (void)ready;
+
+    machine.Reset();
+
+    if (!fixed_rom) {
+        if (size < 3)
+            return 0;
+
+        int machine_index = data[0] & 3;
+        Quirks quirks = QuirksFor(machine_index == 3 ? Machine::Chip8 : static_cast<Machine>(machine_index));
+        quirks.display_wait = data[0] & 4;
+        machine.SetQuirks(quirks);
+
+        size_t rom_size = data[1] | data[2] << 8;
+        data += 3;
+        size -= 3;
+        if (rom_size > size)
+            rom_size = size;
+        if (!machine.LoadGame(data, rom_size))
+            return 0;
+        data += rom_size;
+        size -= rom_size;
+    }
+
+    RunScript(data, size);
+    return 0;
+}
+
+#ifdef CHIP8_FUZZ_MAIN
+// Compilers without libFuzzer get a driver that replays test cases, e.g. a corpus or a crash file.
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        std::ifstream file(argv[i], std::ios::binary);
+        std::vector<uint8_t> input((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        LLVMFuzzerTestOneInput(input.data(), input.size());
+    }
+    return 0;
+}
+#endif
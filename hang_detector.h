@@ -0,0 +1,40 @@
+#ifndef HANG_DETECTOR_H
+#define HANG_DETECTOR_H
+
+#include <cstdint>
+
+// Notices a machine going round in circles, from one state hash per frame. Brent's cycle detection:
+// the saved hash jumps to the current one at every power of two, so a loop of any length is caught
+// within about twice its length plus the frames it took to enter it, at one compare per frame.
+class HangDetector {
+public:
+    // Returns true once hash has been seen before.
+    bool Observe(uint64_t hash) {
+        if (started && hash == saved)
+            return true;
+
+        if (!started || length == power) {
+            saved = hash;
+            power *= 2;
+            length = 0;
+            started = true;
+        }
+        ++length;
+        return false;
+    }
+
+    // Something outside the hashed state changed, e.g. input arrived. Earlier hashes prove nothing now.
+    void Restart() {
+        started = false;
+        power = 1;
+        length = 0;
+    }
+
+private:
+    uint64_t saved = 0;
+    uint64_t power = 1;
+    uint64_t length = 0;
+    bool started = false;
+};
+
+#endif
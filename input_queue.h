@@ -0,0 +1,49 @@
+#ifndef INPUT_QUEUE_H
+#define INPUT_QUEUE_H
+
+#include <atomic>
+#include <cstdint>
+
+// One keypad transition, stamped with the host time it happened at (nanoseconds, SDL_GetTicksNS clock).
+struct KeyEvent {
+    uint64_t timestamp;
+    uint8_t key; // Keypad index, 0x0 - 0xF.
+    bool pressed;
+};
+
+// Lock-free single producer, single consumer ring of key events.
+// The frontend pushes, the core pops when it reaches the matching cycle.
+class KeyEventQueue {
+public:
+    static constexpr uint32_t CAPACITY = 256; // Must be a power of two.
+
+    bool Push(KeyEvent const& event) {
+        uint32_t tail = write_index.load(std::memory_order_relaxed);
+        if (tail - read_index.load(std::memory_order_acquire) == CAPACITY)
+            return false; // Full, drop the event.
+        events[tail & (CAPACITY - 1)] = event;
+        write_index.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Returns the oldest event without removing it, or nullptr if the queue is empty.
+    KeyEvent const* Peek() const {
+        uint32_t head = read_index.load(std::memory_order_relaxed);
+        if (head == write_index.load(std::memory_order_acquire))
+            return nullptr;
+        return &events[head & (CAPACITY - 1)];
+    }
+
+    void Pop() {
+        read_index.store(read_index.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    bool Empty() const { return Peek() == nullptr; }
+
+private:
+    KeyEvent events[CAPACITY];
+    alignas(64) std::atomic<uint32_t> write_index{0};
+    alignas(64) std::atomic<uint32_t> read_index{0};
+};
+
+#endif
@@ -0,0 +1,49 @@
+#include "input_script.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+void InputScript::Load(char const* filename) {
+    std::ifstream file(filename);
+
+    if (!file.is_open()) {
+        std::cerr << "Failed to open input script.\n";
+        exit(1);
+    }
+
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line)) {
+        ++line_number;
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream fields(line);
+        uint64_t frame;
+        std::string key;
+        std::string state;
+        if (!(fields >> frame))
+            continue; // Blank or comment line.
+
+        if (!(fields >> key >> state) || key.size() != 1 || !isxdigit(key[0]) || (state != "down" && state != "up")) {
+            std::cerr << "Bad input script line " << line_number << ": " << line << "\n";
+            exit(1);
+        }
+
+        entries.push_back({ frame, static_cast<uint8_t>(std::stoi(key, nullptr, 16)), state == "down" });
+    }
+
+    std::stable_sort(entries.begin(), entries.end(), [](Entry const& a, Entry const& b) { return a.frame < b.frame; });
+    next = 0;
+}
+
+int InputScript::Inject(uint64_t frame, uint64_t timestamp, KeyEventQueue& queue) {
+    int pushed = 0;
+    while (next < entries.size() && entries[next].frame <= frame) {
+        queue.Push({ timestamp, entries[next].key, entries[next].pressed });
+        ++next;
+        ++pushed;
+    }
+    return pushed;
+}
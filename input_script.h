@@ -0,0 +1,28 @@
+#ifndef INPUT_SCRIPT_H
+#define INPUT_SCRIPT_H
+
+#include <cstdint>
+#include <vector>
+#include "input_queue.h"
+
+// Synthetic input for headless runs. One event per line: "<frame> <key hex> <down|up>", '#' starts a comment.
+class InputScript {
+public:
+    struct Entry {
+        uint64_t frame;
+        uint8_t key;
+        bool pressed;
+    };
+
+    void Load(char const* filename);
+
+    // Pushes every event scheduled for this frame, stamped with timestamp. Returns how many were pushed.
+    int Inject(uint64_t frame, uint64_t timestamp, KeyEventQueue& queue);
+    bool Finished() const { return next >= entries.size(); }
+
+private:
+    std::vector<Entry> entries; // Sorted by frame.
+    size_t next = 0;
+};
+
+#endif
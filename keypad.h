@@ -0,0 +1,35 @@
+#ifndef KEYPAD_H
+#define KEYPAD_H
+
+#include <atomic>
+#include <cstdint>
+
+// The 16 key hexadecimal keypad as one bit per key, bit 0 is key 0.
+// Atomic so a frontend thread can publish keys while the core runs. Copies take a snapshot,
+// which keeps the machine copyable for Reset baselines and search branches.
+class Keypad {
+public:
+    Keypad() = default;
+    Keypad(Keypad const& other) : bits(other.Get()) {}
+    Keypad& operator=(Keypad const& other) {
+        Set(other.Get());
+        return *this;
+    }
+
+    uint16_t Get() const { return bits.load(std::memory_order_acquire); }
+    void Set(uint16_t keys) { bits.store(keys, std::memory_order_release); }
+    bool Pressed(int key) const { return Get() >> (key & 0xF) & 1; }
+
+    void Press(int key, bool pressed) {
+        uint16_t bit = static_cast<uint16_t>(1 << (key & 0xF));
+        if (pressed)
+            bits.fetch_or(bit, std::memory_order_acq_rel);
+        else
+            bits.fetch_and(static_cast<uint16_t>(~bit), std::memory_order_acq_rel);
+    }
+
+private:
+    std::atomic<uint16_t> bits{0};
+};
+
+#endif
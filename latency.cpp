@@ -0,0 +1,84 @@
+#include "latency.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+
+void LatencyProbe::OnInput(uint64_t timestamp) {
+    pending.push_back({ timestamp, UINT64_MAX });
+}
+
+// Events with the same stamp are applied in the order they were injected.
+void LatencyProbe::OnApplied(uint64_t timestamp, uint64_t cycle) {
+    for (PendingInput& input : pending)
+        if (input.timestamp == timestamp && input.cycle == UINT64_MAX) {
+            input.cycle = cycle;
+            return;
+        }
+}
+
+void LatencyProbe::OnPresent(uint64_t timestamp, uint64_t cycle, void const* frame, size_t size) {
+    bool changed = last_frame.size() != size || memcmp(last_frame.data(), frame, size) != 0;
+    if (!changed)
+        return;
+
+    last_frame.assign(static_cast<unsigned char const*>(frame), static_cast<unsigned char const*>(frame) + size);
+
+    // The first visible change produced once an input is in is the one we attribute to it.
+    std::erase_if(pending, [&](PendingInput const& input) {
+        if (cycle < input.cycle)
+            return false;
+        if (timestamp >= input.timestamp)
+            samples.push_back(timestamp - input.timestamp);
+        return true;
+    });
+}
+
+void LatencyProbe::Report(std::ostream& out, char const* rom_name) {
+    const int BUCKETS = 50; // 1ms wide, the last one collects everything slower.
+    int histogram[BUCKETS] = {};
+
+    std::sort(samples.begin(), samples.end());
+    for (uint64_t sample : samples)
+        ++histogram[std::min<uint64_t>(sample / 1000000, BUCKETS - 1)];
+
+    auto percentile = [&](int p) {
+        return samples.empty() ? 0.0 : samples[(samples.size() - 1) * p / 100] / 1e6;
+    };
+
+    out << std::fixed << std::setprecision(3);
+    out << "rom " << rom_name << " samples " << samples.size() << " unanswered " << pending.size()
+        << " p50_ms " << percentile(50) << " p99_ms " << percentile(99) << " max_ms " << percentile(100) << "\n";
+    out << "histogram_ms";
+    for (int i = 0; i < BUCKETS; ++i)
+        if (histogram[i])
+            out << " " << i << (i == BUCKETS - 1 ? "+:" : ":") << histogram[i];
+    out << "\n";
+}
+
+void FrameTimeStats::Add(uint64_t timestamp) {
+    if (last && timestamp >= last)
+        intervals.push_back(timestamp - last);
+    last = timestamp;
+}
+
+void FrameTimeStats::Report(std::ostream& out, char const* label) {
+    double mean = 0.0;
+    for (uint64_t interval : intervals)
+        mean += interval / 1e6;
+    mean = intervals.empty() ? 0.0 : mean / intervals.size();
+
+    double variance = 0.0;
+    for (uint64_t interval : intervals)
+        variance += (interval / 1e6 - mean) * (interval / 1e6 - mean);
+    variance = intervals.empty() ? 0.0 : variance / intervals.size();
+
+    std::sort(intervals.begin(), intervals.end());
+    auto percentile = [&](int p) {
+        return intervals.empty() ? 0.0 : intervals[(intervals.size() - 1) * p / 100] / 1e6;
+    };
+
+    out << std::fixed << std::setprecision(3);
+    out << label << " intervals " << intervals.size() << " mean_ms " << mean << " stddev_ms " << std::sqrt(variance)
+        << " p99_ms " << percentile(99) << " max_ms " << percentile(100) << "\n";
+}
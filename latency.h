@@ -0,0 +1,40 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// Measures input to display latency: from the time a key event is injected to the time
+// SDL_RenderPresent returns for the first changed frame produced at or after the cycle the core applied the
+// event on. A frame the emulation had already finished before the key reached the core can't answer it.
+class LatencyProbe {
+public:
+    void OnInput(uint64_t timestamp);
+    void OnApplied(uint64_t timestamp, uint64_t cycle); // The core applied the event stamped timestamp before cycle.
+    void OnPresent(uint64_t timestamp, uint64_t cycle, void const* frame, size_t size); // A frame produced at cycle.
+    void Report(std::ostream& out, char const* rom_name);
+
+private:
+    struct PendingInput {
+        uint64_t timestamp;
+        uint64_t cycle; // UINT64_MAX until the core applies it.
+    };
+
+    std::vector<PendingInput> pending; // Inputs still waiting for a visible change.
+    std::vector<uint64_t> samples; // Latencies in nanoseconds.
+    std::vector<unsigned char> last_frame;
+};
+
+// Spread of the time between consecutive events, e.g. frame starts or presents, to measure jitter.
+class FrameTimeStats {
+public:
+    void Add(uint64_t timestamp);
+    void Report(std::ostream& out, char const* label);
+
+private:
+    uint64_t last = 0;
+    std::vector<uint64_t> intervals; // Nanoseconds.
+};
+
+#endif
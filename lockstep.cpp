@@ -0,0 +1,162 @@
+#include "lockstep.h"
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include "analyzer.h"
+
+namespace {
+
+// One instruction at a time, the reference.
+void RunStep(chip8& machine, int cycles) {
+    for (int i = 0; i < cycles;) {
+        int cost = machine.GetInstructionCycles(); // Charged for the instruction it runs, like RunCycles.
+        machine.EmulateCycle();
+        i += cost;
+    }
+}
+
+// The batch loop the frontend uses, with its own display wait and fault handling.
+void RunBatch(chip8& machine, int cycles) {
+    machine.RunCycles(cycles, 0, 0);
+}
+
+constexpr Engine ENGINES[] = {
+    { "step", RunStep },
+    { "batch", RunBatch },
+};
+
+// Scripted keys go straight to both keypads at the start of the frame, the same way for every engine.
+void ApplyScript(InputScript& script, uint64_t frame, chip8& a, chip8& b) {
+    KeyEventQueue queue;
+    script.Inject(frame, 0, queue);
+    while (KeyEvent const* event = queue.Peek()) {
+        a.keypad.Press(event->key, event->pressed);
+        b.keypad.Press(event->key, event->pressed);
+        queue.Pop();
+    }
+}
+
+// The instruction the machine is about to run, as pc, opcode and the following word for F000 NNNN.
+std::string NextInstruction(chip8& machine) {
+    unsigned short pc = machine.GetPC();
+    uint16_t opcode = machine.GetMemory(pc) << 8 | machine.GetMemory((pc + 1) & 0xFFFF);
+    uint16_t next = machine.GetMemory((pc + 2) & 0xFFFF) << 8 | machine.GetMemory((pc + 3) & 0xFFFF);
+
+    char prefix[16];
+    snprintf(prefix, sizeof(prefix), "%04X  %04X  ", pc, opcode);
+    return prefix + DisassembleInstruction(opcode, next);
+}
+
+void ReportMemoryDifferences(chip8& a, chip8& b, std::ostream& out) {
+    int shown = 0;
+    for (int address = 0; address < 65536 && shown < 8; ++address) {
+        if (a.GetMemory(address) == b.GetMemory(address))
+            continue;
+
+        char line[64];
+        snprintf(line, sizeof(line), "memory %04X: %02X vs %02X\n", address, a.GetMemory(address), b.GetMemory(address));
+        out << line;
+        ++shown;
+    }
+}
+
+}
+
+Engine const* FindEngine(char const* name) {
+    for (Engine const& engine : ENGINES)
+        if (strcmp(engine.name, name) == 0)
+            return &engine;
+    return nullptr;
+}
+
+void PrintEngineNames(std::ostream& out) {
+    for (Engine const& engine : ENGINES)
+        out << " " << engine.name;
+}
+
+bool RunLockstep(Engine const& a, Engine const& b, chip8 const& start, InputScript const& script,
+                 LockstepOptions const& options, std::ostream& out) {
+    // Machines are 70 KB each, keep them off the stack.
+    auto machine_a = std::make_unique<chip8>(start);
+    auto machine_b = std::make_unique<chip8>(start);
+    auto checkpoint_a = std::make_unique<chip8>(start);
+    auto checkpoint_b = std::make_unique<chip8>(start);
+    InputScript input = script;
+    InputScript checkpoint_input = script;
+    uint64_t checkpoint_frame = 0;
+
+    // Full speed: both engines run whole frames and only hashes are compared, every check_interval frames.
+    uint64_t frame = 0;
+    for (; frame < options.frames; ++frame) {
+        ApplyScript(input, frame, *machine_a, *machine_b);
+        a.run(*machine_a, options.cycles_per_frame);
+        b.run(*machine_b, options.cycles_per_frame);
+        machine_a->UpdateTimers();
+        machine_b->UpdateTimers();
+
+        if ((frame + 1) % options.check_interval != 0 && frame + 1 != options.frames)
+            continue;
+        if (machine_a->GetStateHash() != machine_b->GetStateHash())
+            break;
+
+        *checkpoint_a = *machine_a;
+        *checkpoint_b = *machine_b;
+        checkpoint_input = input;
+        checkpoint_frame = frame + 1;
+    }
+
+    if (frame == options.frames)
+        return true;
+
+    // Replay from the last checkpoint a frame at a time to find the frame that diverged.
+    uint64_t failed_frame = frame;
+    *machine_a = *checkpoint_a;
+    *machine_b = *checkpoint_b;
+    input = checkpoint_input;
+    for (frame = checkpoint_frame; frame <= failed_frame; ++frame) {
+        *checkpoint_a = *machine_a;
+        *checkpoint_b = *machine_b;
+        checkpoint_input = input;
+
+        ApplyScript(input, frame, *machine_a, *machine_b);
+        a.run(*machine_a, options.cycles_per_frame);
+        b.run(*machine_b, options.cycles_per_frame);
+        machine_a->UpdateTimers();
+        machine_b->UpdateTimers();
+        if (machine_a->GetStateHash() != machine_b->GetStateHash())
+            break;
+    }
+
+    if (frame > failed_frame) {
+        out << "Diverged by frame " << failed_frame << " but not on replay, an engine is not deterministic\n";
+        return false;
+    }
+
+    // Then rerun growing prefixes of that frame. Each engine always runs its own batch from the frame start,
+    // so a batching engine is compared as it really runs.
+    std::string divergent = NextInstruction(*checkpoint_a);
+    int instruction = 0;
+    for (; instruction < options.cycles_per_frame; ++instruction) {
+        *machine_a = *checkpoint_a;
+        *machine_b = *checkpoint_b;
+        input = checkpoint_input;
+        ApplyScript(input, frame, *machine_a, *machine_b);
+        a.run(*machine_a, instruction + 1);
+        b.run(*machine_b, instruction + 1);
+        if (machine_a->GetStateHash() != machine_b->GetStateHash())
+            break;
+        divergent = NextInstruction(*machine_a);
+    }
+
+    if (instruction == options.cycles_per_frame)
+        out << "Diverged in the timer update at the end of frame " << frame << "\n";
+    else
+        out << "Diverged at frame " << frame << ", instruction " << instruction << " of the frame\n" << divergent << "\n";
+
+    out << a.name << ":\n";
+    machine_a->PrintState(out);
+    out << b.name << ":\n";
+    machine_b->PrintState(out);
+    ReportMemoryDifferences(*machine_a, *machine_b, out);
+    return false;
+}
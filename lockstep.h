@@ -0,0 +1,30 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <cstdint>
+#include <ostream>
+#include "chip8.h"
+#include "input_script.h"
+
+// One way of executing the core. Engines may differ in how they run instructions, never in the state they produce.
+struct Engine {
+    char const* name;
+    void (*run)(chip8& machine, int cycles);
+};
+
+// Engine by name, nullptr if there is none.
+Engine const* FindEngine(char const* name);
+void PrintEngineNames(std::ostream& out);
+
+struct LockstepOptions {
+    uint64_t frames = 3600;
+    int cycles_per_frame = 10;
+    int check_interval = 60; // Frames between state hash compares.
+};
+
+// Runs two engines side by side from the same machine and input. Returns true if they agree for the whole run,
+// otherwise narrows the mismatch down to the first divergent instruction and reports both states to out.
+bool RunLockstep(Engine const& a, Engine const& b, chip8 const& start, InputScript const& script,
+                 LockstepOptions const& options, std::ostream& out);
+
+#endif
@@ -0,0 +1,73 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include "chip8.h"
+#include "lockstep.h"
+#include "romdb.h"
+
+// Runs a ROM on two execution engines in lockstep and reports the first instruction where they disagree.
+int main(int argc, char **argv) {
+    char const* engine_names[2] = { "step", "batch" };
+    char const* input_script_file = nullptr;
+    char const* machine_name = nullptr;
+    LockstepOptions options;
+    int cycles_per_frame = 0;
+    int arg = 1;
+
+    for (; arg < argc && argv[arg][0] == '-'; ++arg) {
+        if (strcmp(argv[arg], "--engines") == 0 && arg + 2 < argc) {
+            engine_names[0] = argv[++arg];
+            engine_names[1] = argv[++arg];
+        }
+        else if (strcmp(argv[arg], "--frames") == 0 && arg + 1 < argc)
+            options.frames = std::stoull(argv[++arg]);
+        else if (strcmp(argv[arg], "--cycles") == 0 && arg + 1 < argc)
+            cycles_per_frame = std::stoi(argv[++arg]);
+        else if (strcmp(argv[arg], "--interval") == 0 && arg + 1 < argc)
+            options.check_interval = std::max(1, std::stoi(argv[++arg]));
+        else if (strcmp(argv[arg], "--input-script") == 0 && arg + 1 < argc)
+            input_script_file = argv[++arg];
+        else if (strcmp(argv[arg], "--machine") == 0 && arg + 1 < argc)
+            machine_name = argv[++arg];
+        else
+            break;
+    }
+
+    Engine const* a = FindEngine(engine_names[0]);
+    Engine const* b = FindEngine(engine_names[1]);
+    if (arg + 1 != argc || !a || !b) {
+        std::cerr << "Usage: " << argv[0] << " [--engines <a> <b>] [--frames <n>] [--cycles <n>] [--interval <frames>]\n"
+                  << "       [--input-script <file>] [--machine chip8|schip|xochip] <ROM>\n"
+                  << "Engines:";
+        PrintEngineNames(std::cerr);
+        std::cerr << "\n";
+        return 1;
+    }
+
+    // Both engines start from this machine, with a fixed seed so CXNN agrees.
+    std::unique_ptr<chip8> start(new chip8);
+    start->Initialize();
+    start->SetSeed(1);
+    start->LoadGame(argv[arg]);
+
+    MachineSetup setup;
+    if (!ResolveMachine(start->GetRomSha1(), machine_name, cycles_per_frame, setup))
+        return 1;
+    start->SetQuirks(setup.quirks);
+
+    if (setup.cycles_per_frame)
+        options.cycles_per_frame = setup.cycles_per_frame;
+    if (Timing::CYCLE_ACCURATE) // The VIP fixes the speed, a frame is its interpreter budget.
+        options.cycles_per_frame = Timing::FRAME_CYCLES;
+
+    InputScript script;
+    if (input_script_file)
+        script.Load(input_script_file);
+
+    if (!RunLockstep(*a, *b, *start, script, options, std::cout))
+        return 2;
+
+    std::cout << a->name << " and " << b->name << " agree for " << options.frames << " frames\n";
+    return 0;
+}
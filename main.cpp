@@ -1,67 +1,439 @@
 #include <iostream>
-#include <chrono>
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <stdio.h>
 #include "platform.h" // SDL for graphics and input.
 #include "chip8.h" // My cpu core implementation.
+#include "input_script.h"
+#include "latency.h"
+#include "rompack.h"
+#include "romdb.h"
+#include "hang_detector.h"
+#include "movie.h"
+#include "triple_buffer.h"
 
 chip8 my_chip8;
+KeyEventQueue input_queue; // Emulation thread to core.
+KeyEventQueue host_queue; // Main thread to emulation thread.
+
+// A finished screen, handed from the emulation thread to the main thread.
+struct Frame {
+    PackedRow planes[2][64];
+    int width;
+    int height;
+    uint64_t cycle; // Cycle count the frame was finished at.
+};
+
+// Saves the screen as a binary PGM, palette index 0-3 as four grey levels.
+void WriteFrame(char const* filename) {
+    std::ofstream file(filename, std::ios::binary);
+    file << "P5\n" << my_chip8.GetWidth() << " " << my_chip8.GetHeight() << "\n255\n";
+    for (int i = 0; i < my_chip8.GetWidth() * my_chip8.GetHeight(); ++i)
+        file.put(static_cast<char>(my_chip8.GetGFX(i) * 85));
+}
 
 int main(int argc, char **argv) {
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <Scale> <ROM>\n";
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <Scale> <ROM> [options]\n"
+                  << "  --keymap <keys>          16 key names for keypad 0-F, default X123QWEASDZC4RFV\n"
+                  << "  --headless               Use the SDL dummy video driver\n"
+                  << "  --frames <n>             Quit after n frames\n"
+                  << "  --input-script <file>    Inject key events from a script\n"
+                  << "  --latency-report <file>  Append input to display latency stats to a file\n"
+                  << "  --frame-stats <file>     Append emulation and present frame time jitter to a file\n"
+                  << "  --display-wait           DXYN waits for the vertical blank (COSMAC VIP)\n"
+                  << "  --palette <colors>       Comma separated RRGGBBAA colors, background first, up to 4\n"
+                  << "  --pack <file>            Load <ROM> (name or hex hash) from a ROM pack\n"
+                  << "  --machine <name>         chip8, schip or xochip, instead of the ROM database\n"
+                  << "  --cycles <n>             Instructions per frame, instead of the ROM database\n"
+                  << "  --seed <n>               CXNN seed, to replay a search's input script, default the clock\n"
+                  << "  --speed <factor>         Emulation speed, e.g. 0.25 for slow motion or 2 for double speed\n"
+                  << "  --turbo                  Start in fast-forward, as fast as possible with 60 presents per second\n"
+                  << "  --benchmark              Run as fast as possible without presenting, then print MIPS and FPS\n"
+                  << "  --detect-halt            Quit once the ROM loops forever, for batch runs without live input\n"
+                  << "  --final-frame <file>     Save the last screen as a PGM image on exit\n"
+                  << "  --record <file>          Record the run as a movie\n"
+                  << "  --play <file>            Replay a movie and check it ends in the recorded state\n";
         std::exit(EXIT_FAILURE);
     }
 
-    // Set up render system and register input callbacks.
     int video_scale = std::stoi(argv[1]);
     char const* game_file_name = argv[2];
+    char const* keymap = nullptr;
+    char const* input_script_file = nullptr;
+    char const* latency_report_file = nullptr;
+    char const* frame_stats_file = nullptr;
+    char const* pack_file = nullptr;
+    bool headless = false;
+    bool display_wait = false;
+    bool detect_halt = false;
+    char const* final_frame_file = nullptr;
+    char const* record_file = nullptr;
+    char const* play_file = nullptr;
+    char const* machine_name = nullptr;
+    int cycles_per_frame = 0;
+    uint64_t seed = time(nullptr);
+    uint32_t palette[4] = { 0x000000FF, 0xFFFFFFFF, 0xAAAAAAFF, 0x555555FF };
+    bool custom_palette = false;
+    uint64_t max_frames = 0;
+    double initial_speed = 1.0;
+    bool initial_turbo = false;
+    bool benchmark = false;
+
+    for (int i = 3; i < argc; ++i) {
+        if (strcmp(argv[i], "--keymap") == 0 && i + 1 < argc)
+            keymap = argv[++i];
+        else if (strcmp(argv[i], "--headless") == 0)
+            headless = true;
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            max_frames = std::stoull(argv[++i]);
+        else if (strcmp(argv[i], "--input-script") == 0 && i + 1 < argc)
+            input_script_file = argv[++i];
+        else if (strcmp(argv[i], "--latency-report") == 0 && i + 1 < argc)
+            latency_report_file = argv[++i];
+        else if (strcmp(argv[i], "--frame-stats") == 0 && i + 1 < argc)
+            frame_stats_file = argv[++i];
+        else if (strcmp(argv[i], "--pack") == 0 && i + 1 < argc)
+            pack_file = argv[++i];
+        else if (strcmp(argv[i], "--display-wait") == 0)
+            display_wait = true;
+        else if (strcmp(argv[i], "--detect-halt") == 0)
+            detect_halt = true;
+        else if (strcmp(argv[i], "--final-frame") == 0 && i + 1 < argc)
+            final_frame_file = argv[++i];
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            record_file = argv[++i];
+        else if (strcmp(argv[i], "--play") == 0 && i + 1 < argc)
+            play_file = argv[++i];
+        else if (strcmp(argv[i], "--machine") == 0 && i + 1 < argc)
+            machine_name = argv[++i];
+        else if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc)
+            cycles_per_frame = std::stoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+            seed = std::stoull(argv[++i]);
+        else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc)
+            initial_speed = std::stod(argv[++i]);
+        else if (strcmp(argv[i], "--turbo") == 0)
+            initial_turbo = true;
+        else if (strcmp(argv[i], "--benchmark") == 0)
+            benchmark = true;
+        else if (strcmp(argv[i], "--palette") == 0 && i + 1 < argc) {
+            char* colors = argv[++i];
+            for (int c = 0; c < 4 && *colors; ++c) {
+                palette[c] = static_cast<uint32_t>(strtoul(colors, &colors, 16));
+                if (*colors == ',')
+                    ++colors;
+            }
+            custom_palette = true;
+        }
+        else {
+            std::cerr << "Unknown option: " << argv[i] << "\n";
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    if (play_file && (record_file || input_script_file)) {
+        std::cerr << "A movie replays its own input, --play can't be combined with --record or --input-script.\n";
+        std::exit(EXIT_FAILURE);
+    }
+
+    Movie movie;
+    if (play_file && !movie.Load(play_file)) {
+        std::cerr << "Failed to load movie.\n";
+        std::exit(EXIT_FAILURE);
+    }
+
+    if (!(initial_speed > 0.0)) {
+        std::cerr << "Speed must be above zero.\n";
+        std::exit(EXIT_FAILURE);
+    }
+
+    // A benchmark needs an end.
+    if (benchmark && !max_frames)
+        max_frames = 3600;
+
+    // Set up render system and register input callbacks.
+    if (headless)
+        SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "dummy");
     Platform my_platform("CHIP-8 Interpreter", video_scale, video_scale, 64, 32);
 
+    if (keymap && !my_platform.SetKeymap(keymap)) {
+        std::cerr << "Invalid keymap, expected 16 key names like X123QWEASDZC4RFV.\n";
+        std::exit(EXIT_FAILURE);
+    }
+
+    if (custom_palette)
+        my_platform.SetPalette(palette);
+
+    InputScript input_script;
+    if (input_script_file)
+        input_script.Load(input_script_file);
+    LatencyProbe latency_probe;
+
     // Initialize Chip 8 system and load game into memory.
     my_chip8.Initialize();
-    my_chip8.LoadGame(game_file_name);
+    if (pack_file) {
+        RomPack pack;
+        if (!pack.Open(pack_file)) {
+            std::cerr << "Failed to open ROM pack.\n";
+            std::exit(EXIT_FAILURE);
+        }
+
+        RomPackEntry const* entry = pack.FindByName(game_file_name);
+        if (!entry)
+            entry = pack.Find(std::strtoull(game_file_name, nullptr, 16));
+        if (!entry || !my_chip8.LoadGame(pack.Data(*entry), entry->size)) {
+            std::cerr << "ROM not found in pack.\n";
+            std::exit(EXIT_FAILURE);
+        }
+    }
+    else
+        my_chip8.LoadGame(game_file_name);
+    my_chip8.SetInputQueue(&input_queue);
+
+    // Known ROMs get their machine's quirks and speed from the database, the command line wins.
+    MachineSetup setup;
+    if (!ResolveMachine(my_chip8.GetRomSha1(), machine_name, cycles_per_frame, setup))
+        std::exit(EXIT_FAILURE);
+    if (display_wait)
+        setup.quirks.display_wait = true;
+    my_chip8.SetQuirks(setup.quirks);
+    cycles_per_frame = setup.cycles_per_frame;
+
+    // Emulation loop.
+    const int TIMER_HZ = 60; // 60Hz for timers, also one emulated frame.
+    int cycles_per_second = cycles_per_frame ? cycles_per_frame * TIMER_HZ : 500; // 500Hz for unknown CHIP-8 ROMs.
+
+    // A movie brings its own settings and seed, and the keypad follows it instead of the host.
+    if (play_file) {
+        if (movie.header.rom_hash != my_chip8.GetRomHash()) {
+            std::cerr << "The movie was recorded with a different ROM.\n";
+            std::exit(EXIT_FAILURE);
+        }
+        my_chip8.SetQuirks(UnpackQuirks(movie.header.quirks));
+        cycles_per_second = static_cast<int>(movie.header.cycles_per_second);
+        seed = movie.header.seed;
+        max_frames = movie.header.frames;
+        my_chip8.SetInputQueue(nullptr);
+    }
+    my_chip8.SetSeed(seed);
+    my_chip8.SetCyclesPerSecond(cycles_per_second);
+
 
     // Debug, print first 10 bytes of game
     // for (int i = 512; i < 522; ++i)
     //     printf("%X\n", my_chip8.GetMemory(i));
 
-    // Emulation loop.
-    const int CYCLES_PER_SECOND = 500; // Target 500Hz for CHIP-8
-    const int TIMER_HZ = 60; // 60Hz for timers
-    const float CYCLE_DELAY = 1000.0f / CYCLES_PER_SECOND;
-    const float TIMER_DELAY = 1000.0f / TIMER_HZ;
+    const Uint64 FRAME_DELAY = SDL_NS_PER_SECOND / TIMER_HZ;
 
-    auto last_cycle_time = std::chrono::high_resolution_clock::now();
-    auto last_timer_time = last_cycle_time;
-    bool quit = false;
+    // Emulation runs on its own thread, so a slow present never holds it up and the other way round.
+    // Host key events cross over through host_queue, finished frames through the triple buffer.
+    std::atomic<bool> quit{false};
+    TripleBuffer<Frame> frames;
+    std::mutex latency_mutex; // Inputs are seen by the emulation thread, presents by the main thread.
+    FrameTimeStats emulation_stats;
+    FrameTimeStats present_stats;
+    uint64_t frame = 0;
 
-    while (!quit) {
-        // Store key press state (Press and Release) and exit.
-        quit = my_platform.ProcessInput(my_chip8.key);
+    // The core's queue only has the emulation thread as producer, next to the script. Host events are moved
+    // over lazily: the first EX9E, EXA1 or FX0A of a frame asks for them, right when the ROM reads the keypad.
+    auto forward_host_input = [&]() {
+        while (KeyEvent const* event = host_queue.Peek()) {
+            if (!play_file) // During playback host keys are thrown away.
+                input_queue.Push(*event);
+            host_queue.Pop();
+        }
+    };
+    my_chip8.SetInputHook(forward_host_input);
+
+    // The cycle a key event takes effect on, for the movie and to match it with the frames it can show up in.
+    if (record_file || latency_report_file)
+        my_chip8.SetKeyListener([&](KeyEvent const& event) {
+            if (record_file)
+                movie.Record(my_chip8);
+            if (latency_report_file) {
+                std::lock_guard<std::mutex> lock(latency_mutex);
+                latency_probe.OnApplied(event.timestamp, my_chip8.GetCycleCount());
+            }
+        });
+
+    // Speed only changes how fast emulated frames pass in wall time. Each frame still runs the same cycles and one
+    // timer tick, so timers stay in step with the instructions at any speed. Headless playback and benchmarks are uncapped.
+    const double MIN_SPEED = 1.0 / 16;
+    const double MAX_SPEED = 16.0;
+    std::atomic<double> speed{initial_speed};
+    std::atomic<bool> turbo{initial_turbo};
+    bool uncapped = benchmark || (play_file && headless);
+    my_platform.SetHotkeyHandler([&](Hotkey hotkey) {
+        switch (hotkey) {
+            case Hotkey::Slower: speed = std::max(speed / 2, MIN_SPEED); break;
+            case Hotkey::Faster: speed = std::min(speed * 2, MAX_SPEED); break;
+            case Hotkey::NormalSpeed: speed = 1.0; turbo = false; break;
+            case Hotkey::Turbo: turbo = !turbo; break;
+        }
+        std::cout << "Speed " << (turbo ? "fast-forward" : std::to_string(speed.load()) + "x") << "\n";
+    });
 
-        auto current_time = std::chrono::high_resolution_clock::now();
-        float dt = std::chrono::duration<float, std::chrono::milliseconds::period>(current_time - last_cycle_time).count();
-        float timer_dt = std::chrono::duration<float, std::chrono::milliseconds::period>(current_time - last_timer_time).count();
+    Uint64 benchmark_start = SDL_GetTicksNS();
+    std::thread emulation([&]() {
+        // Same clock as SDL event timestamps, so key events can be placed on the right cycle.
+        Uint64 frame_start = SDL_GetTicksNS();
+        Uint64 last_publish = 0;
+        HangDetector hang_detector;
 
-        // Executes one cycle.
-        if (dt > CYCLE_DELAY) {
-            last_cycle_time = current_time;
+        while (!quit) {
+            if (frame_stats_file)
+                emulation_stats.Add(SDL_GetTicksNS());
 
-            my_chip8.EmulateCycle();
+            // Fast frames have no length in wall time, they start whenever the last one is done.
+            bool fast = uncapped || turbo;
+            Uint64 frame_delay = fast ? 0 : static_cast<Uint64>(FRAME_DELAY / speed);
+            if (fast)
+                frame_start = SDL_GetTicksNS();
 
-            // Update the screen.
-            if (my_chip8.GetDrawFlag()) {
-                my_platform.Update(my_chip8.GetGFX());
+            // Scripted input is stamped just before the frame's first cycle, so the core applies it ahead of the first
+            // instruction at any speed. CHIP8-Search and CHIP8-Lockstep press scripted keys at that same point.
+            if (input_script_file) {
+                Uint64 stamp = frame_start - frame_delay - 1;
+                std::lock_guard<std::mutex> lock(latency_mutex);
+                for (int i = input_script.Inject(frame, stamp, input_queue); i > 0; --i)
+                    latency_probe.OnInput(stamp);
+            }
+
+            // Executes one frame worth of cycles for the frame that just elapsed.
+            // The core ticks the timers at the end of it.
+            int cycles = my_chip8.GetFrameCycles(1);
+            if (play_file)
+                movie.Play(my_chip8, cycles);
+            else
+                my_chip8.RunCycles(cycles, frame_start - frame_delay, frame_start);
+
+            // Nothing read the keypad this frame, the events wait in the core's queue for the next one.
+            if (!my_chip8.GetInputPolled())
+                forward_host_input();
+
+            // Publish the screen, at most once per frame no matter how many DXYN ran. Fast-forward
+            // publishes at most 60 times per wall clock second, benchmarks never.
+            if (my_chip8.GetDrawFlag() && !benchmark && (!fast || frame_start - last_publish >= FRAME_DELAY)) {
+                last_publish = frame_start;
+                Frame& out = frames.Back();
+                memcpy(out.planes[0], my_chip8.GetPlane(0), sizeof(out.planes[0]));
+                memcpy(out.planes[1], my_chip8.GetPlane(1), sizeof(out.planes[1]));
+                out.width = my_chip8.GetWidth();
+                out.height = my_chip8.GetHeight();
+                out.cycle = my_chip8.GetCycleCount();
+                frames.Publish();
                 my_chip8.SetDrawFlag(false);
+                my_platform.Wake();
             }
+
+            // With no timer running and no scripted input left, the next frame only depends on the state, so seeing
+            // the same state again means the ROM is done and just loops.
+            if (detect_halt) {
+                if (my_chip8.GetStatus() != Status::Running)
+                    quit = true;
+                else if (!my_chip8.GetTimersIdle() || !input_script.Finished())
+                    hang_detector.Restart();
+                else if (hang_detector.Observe(my_chip8.GetStateHash())) {
+                    my_chip8.Halt();
+                    quit = true;
+                }
+            }
+
+            if (++frame == max_frames)
+                quit = true;
+
+            if (fast)
+                continue;
+
+            // Wait for the next frame, or skip ahead if we stalled.
+            frame_start += frame_delay;
+            Uint64 now = SDL_GetTicksNS();
+            if (frame_start > now)
+                SDL_DelayPrecise(frame_start - now);
+            else if (now - frame_start > FRAME_DELAY * 6)
+                frame_start = now;
         }
+        my_platform.Wake();
+    });
 
-        // Update timers at 60Hz.
-        if (timer_dt > TIMER_DELAY) {
-            last_timer_time = current_time;
-            my_chip8.UpdateTimers();
+    // The main thread only handles window events and presents the newest finished frame. With vsync the
+    // present blocks until the refresh, frames finished meanwhile are skipped instead of queued.
+    while (!quit) {
+        if (my_platform.ProcessInput(host_queue))
+            quit = true;
+
+        if (!frames.Acquire()) {
+            my_platform.WaitForEvent(100);
+            continue;
         }
+
+        Frame const& shown = frames.Front();
+        my_platform.Update(shown.planes[0], shown.planes[1], shown.width, shown.height);
+        Uint64 presented = SDL_GetTicksNS();
+        if (frame_stats_file)
+            present_stats.Add(presented);
+        if (latency_report_file) {
+            std::lock_guard<std::mutex> lock(latency_mutex);
+            latency_probe.OnPresent(presented, shown.cycle, shown.planes, sizeof(shown.planes));
+        }
+    }
+    emulation.join();
+
+    if (benchmark) {
+        double seconds = (SDL_GetTicksNS() - benchmark_start) / 1e9;
+        printf("Benchmark: %llu instructions in %llu frames, %.3f s, %.2f MIPS, %.1f frames per second\n",
+               static_cast<unsigned long long>(my_chip8.GetCycleCount()), static_cast<unsigned long long>(frame), seconds,
+               my_chip8.GetCycleCount() / seconds / 1e6, frame / seconds);
+    }
+
+    if (my_chip8.GetStatus() == Status::Halted)
+        std::cout << "Halted after " << frame << " frames\n";
+    else if (my_chip8.GetStatus() != Status::Running)
+        std::cout << "Stopped on a stack fault after " << frame << " frames\n";
+
+    if (final_frame_file)
+        WriteFrame(final_frame_file);
+
+    int exit_code = 0;
+    if (record_file) {
+        movie.header.rom_hash = my_chip8.GetRomHash();
+        movie.header.seed = seed;
+        movie.header.frames = frame;
+        movie.header.final_state_hash = my_chip8.GetStateHash();
+        movie.header.cycles_per_second = static_cast<uint32_t>(cycles_per_second);
+        movie.header.quirks = PackQuirks(setup.quirks);
+        if (!movie.Save(record_file)) {
+            std::cerr << "Failed to save movie.\n";
+            exit_code = 1;
+        }
+    }
+    else if (play_file) {
+        if (frame != movie.header.frames || my_chip8.GetStateHash() != movie.header.final_state_hash) {
+            std::cout << "Playback diverged after " << frame << " frames\n";
+            exit_code = 1;
+        }
+        else
+            std::cout << "Playback matched after " << frame << " frames\n";
+    }
+
+    if (latency_report_file) {
+        std::ofstream report(latency_report_file, std::ios::app);
+        latency_probe.Report(report, game_file_name);
+    }
+
+    if (frame_stats_file) {
+        std::ofstream report(frame_stats_file, std::ios::app);
+        report << "rom " << game_file_name << "\n";
+        emulation_stats.Report(report, "emulation");
+        present_stats.Report(report, "present");
     }
 
-    return 0;
-}
\ No newline at end of file
+    return exit_code;
+}
@@ -0,0 +1,75 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool MappedFile::Open(char const* filename) {
+    Close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file); // The mapping keeps the file open.
+    if (!mapping)
+        return false;
+
+    data = static_cast<unsigned char const*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!data) {
+        CloseHandle(mapping);
+        mapping = nullptr;
+        return false;
+    }
+    size = static_cast<size_t>(file_size.QuadPart);
+#else
+    int file = open(filename, O_RDONLY);
+    if (file < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(file, &info) != 0 || info.st_size == 0) {
+        close(file);
+        return false;
+    }
+
+    void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    close(file); // The mapping keeps the file open.
+    if (view == MAP_FAILED)
+        return false;
+
+    data = static_cast<unsigned char const*>(view);
+    size = static_cast<size_t>(info.st_size);
+#endif
+
+    return true;
+}
+
+void MappedFile::Close() {
+    if (!data)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+    CloseHandle(mapping);
+    mapping = nullptr;
+#else
+    munmap(const_cast<unsigned char*>(data), size);
+#endif
+
+    data = nullptr;
+    size = 0;
+}
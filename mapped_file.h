@@ -0,0 +1,27 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+
+// Read-only memory mapping of a whole file.
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+    ~MappedFile() { Close(); }
+
+    bool Open(char const* filename);
+    void Close();
+    unsigned char const* Data() const { return data; }
+    size_t Size() const { return size; }
+
+private:
+    unsigned char const* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    void* mapping = nullptr;
+#endif
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include "movie.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+uint8_t PackQuirks(Quirks const& quirks) {
+    return quirks.display_wait | quirks.vf_reset << 1 | quirks.shift_vx << 2 | quirks.memory_leave_i << 3
+         | quirks.jump_vx << 4 | quirks.wrap << 5;
+}
+
+Quirks UnpackQuirks(uint8_t bits) {
+    Quirks quirks;
+    quirks.display_wait = bits & 1;
+    quirks.vf_reset = bits & 2;
+    quirks.shift_vx = bits & 4;
+    quirks.memory_leave_i = bits & 8;
+    quirks.jump_vx = bits & 16;
+    quirks.wrap = bits & 32;
+    return quirks;
+}
+
+bool Movie::Load(char const* filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || memcmp(header.magic, "C8MOVIE", 8) != 0)
+        return false;
+
+    std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    size_t at = 0;
+    uint64_t cycle = 0;
+    events.clear();
+    for (uint32_t i = 0; i < header.event_count; ++i) {
+        uint64_t delta = 0;
+        for (int shift = 0;; shift += 7) {
+            if (at >= data.size() || shift > 63)
+                return false;
+            delta |= static_cast<uint64_t>(data[at] & 0x7F) << shift;
+            if (!(data[at++] & 0x80))
+                break;
+        }
+
+        if (at + 2 > data.size())
+            return false;
+        cycle += delta;
+        events.push_back({ cycle, static_cast<uint16_t>(data[at] | data[at + 1] << 8) });
+        at += 2;
+    }
+
+    next = 0;
+    return true;
+}
+
+bool Movie::Save(char const* filename) const {
+    std::vector<unsigned char> data;
+    uint64_t cycle = 0;
+    for (MovieEvent const& event : events) {
+        uint64_t delta = event.cycle - cycle;
+        do {
+            data.push_back(static_cast<unsigned char>((delta & 0x7F) | (delta > 0x7F ? 0x80 : 0)));
+            delta >>= 7;
+        } while (delta);
+        data.push_back(static_cast<unsigned char>(event.keys));
+        data.push_back(static_cast<unsigned char>(event.keys >> 8));
+        cycle = event.cycle;
+    }
+
+    MovieHeader out = header;
+    memcpy(out.magic, "C8MOVIE", 8);
+    out.event_count = static_cast<uint32_t>(events.size());
+
+    std::ofstream file(filename, std::ios::binary);
+    file.write(reinterpret_cast<char const*>(&out), sizeof(out));
+    file.write(reinterpret_cast<char const*>(data.data()), static_cast<std::streamsize>(data.size()));
+    return static_cast<bool>(file);
+}
+
+// Several changes before the same instruction collapse into one event.
+void Movie::Record(chip8& machine) {
+    uint16_t keys = machine.keypad.Get();
+    if (keys == recorded_keys)
+        return;
+
+    recorded_keys = keys;
+    if (!events.empty() && events.back().cycle == machine.GetCycleCount())
+        events.back().keys = keys;
+    else
+        events.push_back({ machine.GetCycleCount(), keys });
+}
+
+// Runs the batch in pieces that end at each recorded change. A piece can use more cycles than it
+// executes while a DXYN waits for the interrupt, then the next piece still ends at the same change.
+void Movie::Play(chip8& machine, int cycles) {
+    while (cycles > 0) {
+        uint64_t now = machine.GetCycleCount();
+        for (; next < events.size() && events[next].cycle <= now; ++next)
+            machine.keypad.Set(events[next].keys);
+
+        int piece = next < events.size() ? static_cast<int>(std::min<uint64_t>(cycles, events[next].cycle - now)) : cycles;
+        int used = machine.RunCycles(piece, 0, 0);
+        cycles -= used;
+        if (used < piece) // A fault, or a stall with the timers left to the host.
+            break;
+    }
+}
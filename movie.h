@@ -0,0 +1,50 @@
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include <cstdint>
+#include <vector>
+#include "chip8.h"
+
+// Everything needed to replay a run bit for bit: the ROM, machine settings and seed, then each keypad
+// change at the cycle it happened. Events follow the header, each a LEB128 cycle delta from the
+// previous event and the new 16 key bitmask, little endian.
+struct MovieHeader {
+    char magic[8]; // "C8MOVIE"
+    uint64_t rom_hash;
+    uint64_t seed;
+    uint64_t frames; // Length of the recording.
+    uint64_t final_state_hash; // GetStateHash after the last frame, checked by playback.
+    uint32_t cycles_per_second;
+    uint32_t event_count;
+    uint8_t quirks; // One bit per Quirks field, in declaration order.
+    uint8_t reserved[7];
+};
+
+struct MovieEvent {
+    uint64_t cycle; // Applied before the instruction with this cycle count runs.
+    uint16_t keys;
+};
+
+class Movie {
+public:
+    MovieHeader header = {};
+    std::vector<MovieEvent> events;
+
+    bool Load(char const* filename);
+    bool Save(char const* filename) const;
+
+    // Recording: call whenever the keypad may have changed, e.g. from the core's key listener.
+    void Record(chip8& machine);
+
+    // Playback: runs cycles like RunCycles, setting the keypad at each recorded cycle.
+    void Play(chip8& machine, int cycles);
+
+private:
+    size_t next = 0;
+    uint16_t recorded_keys = 0;
+};
+
+uint8_t PackQuirks(Quirks const& quirks);
+Quirks UnpackQuirks(uint8_t bits);
+
+#endif
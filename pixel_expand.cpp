@@ -0,0 +1,184 @@
+#include "pixel_expand.h"
+#include <cstring>
+#include "simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PIXEL_EXPAND_X86
+#endif
+
+namespace {
+
+using ByteRowKernel = void (*)(unsigned char const* src, int width, uint32_t const* palette, uint32_t* out);
+using PackedRowKernel = void (*)(PackedRow const* plane0, PackedRow const* plane1, int width, uint32_t const* palette, uint32_t* out);
+
+// Eight pixels of a packed row, leftmost in bit 7.
+inline unsigned PackedByte(PackedRow const* row, int index) {
+    return row ? static_cast<unsigned>(*row >> (120 - 8 * index)) & 0xFF : 0;
+}
+
+void ExpandByteRowScalar(unsigned char const* src, int width, uint32_t const* palette, uint32_t* out) {
+    for (int x = 0; x < width; ++x)
+        out[x] = palette[src[x] & 3];
+}
+
+void ExpandPackedRowScalar(PackedRow const* plane0, PackedRow const* plane1, int width, uint32_t const* palette, uint32_t* out) {
+    for (int x = 0; x < width; ++x) {
+        int bit = 127 - x;
+        int index = static_cast<int>(*plane0 >> bit) & 1;
+        if (plane1)
+            index |= (static_cast<int>(*plane1 >> bit) & 1) << 1;
+        out[x] = palette[index];
+    }
+}
+
+#ifdef PIXEL_EXPAND_X86
+
+// Picks one of four colours per dword lane from the two index bits.
+inline __m128i Select4(__m128i index, __m128i const* colors) {
+    __m128i bit0 = _mm_cmpeq_epi32(_mm_and_si128(index, _mm_set1_epi32(1)), _mm_set1_epi32(1));
+    __m128i bit1 = _mm_cmpeq_epi32(_mm_and_si128(index, _mm_set1_epi32(2)), _mm_set1_epi32(2));
+    __m128i low = _mm_or_si128(_mm_andnot_si128(bit0, colors[0]), _mm_and_si128(bit0, colors[1]));
+    __m128i high = _mm_or_si128(_mm_andnot_si128(bit0, colors[2]), _mm_and_si128(bit0, colors[3]));
+    return _mm_or_si128(_mm_andnot_si128(bit1, low), _mm_and_si128(bit1, high));
+}
+
+void ExpandByteRowSSE2(unsigned char const* src, int width, uint32_t const* palette, uint32_t* out) {
+    __m128i colors[4];
+    for (int i = 0; i < 4; ++i)
+        colors[i] = _mm_set1_epi32(static_cast<int>(palette[i]));
+
+    __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + x));
+        __m128i words_lo = _mm_unpacklo_epi8(bytes, zero);
+        __m128i words_hi = _mm_unpackhi_epi8(bytes, zero);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), Select4(_mm_unpacklo_epi16(words_lo, zero), colors));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x + 4), Select4(_mm_unpackhi_epi16(words_lo, zero), colors));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x + 8), Select4(_mm_unpacklo_epi16(words_hi, zero), colors));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x + 12), Select4(_mm_unpackhi_epi16(words_hi, zero), colors));
+    }
+    ExpandByteRowScalar(src + x, width - x, palette, out + x);
+}
+
+void ExpandPackedRowSSE2(PackedRow const* plane0, PackedRow const* plane1, int width, uint32_t const* palette, uint32_t* out) {
+    __m128i colors[4];
+    for (int i = 0; i < 4; ++i)
+        colors[i] = _mm_set1_epi32(static_cast<int>(palette[i]));
+
+    // Bit masks for pixels 0-3 and 4-7 of a byte, leftmost pixel first.
+    __m128i bits_lo = _mm_setr_epi32(0x80, 0x40, 0x20, 0x10);
+    __m128i bits_hi = _mm_setr_epi32(0x08, 0x04, 0x02, 0x01);
+
+    for (int i = 0; i < width / 8; ++i) {
+        __m128i byte0 = _mm_set1_epi32(static_cast<int>(PackedByte(plane0, i)));
+        __m128i byte1 = _mm_set1_epi32(static_cast<int>(PackedByte(plane1, i)));
+
+        __m128i index_lo = _mm_or_si128(
+            _mm_and_si128(_mm_cmpeq_epi32(_mm_and_si128(byte0, bits_lo), bits_lo), _mm_set1_epi32(1)),
+            _mm_and_si128(_mm_cmpeq_epi32(_mm_and_si128(byte1, bits_lo), bits_lo), _mm_set1_epi32(2)));
+        __m128i index_hi = _mm_or_si128(
+            _mm_and_si128(_mm_cmpeq_epi32(_mm_and_si128(byte0, bits_hi), bits_hi), _mm_set1_epi32(1)),
+            _mm_and_si128(_mm_cmpeq_epi32(_mm_and_si128(byte1, bits_hi), bits_hi), _mm_set1_epi32(2)));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 8), Select4(index_lo, colors));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 8 + 4), Select4(index_hi, colors));
+    }
+}
+
+// AVX2 can look the colour up directly: the palette sits in one register and vpermd indexes it.
+__attribute__((target("avx2")))
+void ExpandByteRowAVX2(unsigned char const* src, int width, uint32_t const* palette, uint32_t* out) {
+    __m256i colors = _mm256_setr_epi32(palette[0], palette[1], palette[2], palette[3], palette[0], palette[1], palette[2], palette[3]);
+    __m256i three = _mm256_set1_epi32(3);
+
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m128i bytes = _mm_loadl_epi64(reinterpret_cast<__m128i const*>(src + x));
+        __m256i index = _mm256_and_si256(_mm256_cvtepu8_epi32(bytes), three);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), _mm256_permutevar8x32_epi32(colors, index));
+    }
+    ExpandByteRowScalar(src + x, width - x, palette, out + x);
+}
+
+__attribute__((target("avx2")))
+void ExpandPackedRowAVX2(PackedRow const* plane0, PackedRow const* plane1, int width, uint32_t const* palette, uint32_t* out) {
+    __m256i colors = _mm256_setr_epi32(palette[0], palette[1], palette[2], palette[3], palette[0], palette[1], palette[2], palette[3]);
+    __m256i bits = _mm256_setr_epi32(0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+
+    for (int i = 0; i < width / 8; ++i) {
+        __m256i byte0 = _mm256_set1_epi32(static_cast<int>(PackedByte(plane0, i)));
+        __m256i byte1 = _mm256_set1_epi32(static_cast<int>(PackedByte(plane1, i)));
+        __m256i index = _mm256_or_si256(
+            _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_and_si256(byte0, bits), bits), _mm256_set1_epi32(1)),
+            _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_and_si256(byte1, bits), bits), _mm256_set1_epi32(2)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i * 8), _mm256_permutevar8x32_epi32(colors, index));
+    }
+}
+
+#endif
+
+// Chosen once on first use from what the host CPU supports.
+ByteRowKernel PickByteRowKernel() {
+#ifdef PIXEL_EXPAND_X86
+    if (GetSimdLevel() == SimdLevel::AVX2)
+        return ExpandByteRowAVX2;
+    if (GetSimdLevel() == SimdLevel::SSE2)
+        return ExpandByteRowSSE2;
+#endif
+    return ExpandByteRowScalar;
+}
+
+PackedRowKernel PickPackedRowKernel() {
+#ifdef PIXEL_EXPAND_X86
+    if (GetSimdLevel() == SimdLevel::AVX2)
+        return ExpandPackedRowAVX2;
+    if (GetSimdLevel() == SimdLevel::SSE2)
+        return ExpandPackedRowSSE2;
+#endif
+    return ExpandPackedRowScalar;
+}
+
+// Writes one expanded source row to scale output rows, widening every pixel scale times.
+template <typename ExpandRow>
+void ExpandScaled(int width, int height, void* dst, int dst_pitch, int scale, ExpandRow expand_row) {
+    unsigned char* out = static_cast<unsigned char*>(dst);
+    uint32_t row[128];
+
+    for (int y = 0; y < height; ++y) {
+        uint32_t* first_line = reinterpret_cast<uint32_t*>(out);
+
+        if (scale == 1) {
+            expand_row(y, first_line);
+        }
+        else {
+            expand_row(y, row);
+            for (int x = 0; x < width; ++x)
+                for (int s = 0; s < scale; ++s)
+                    first_line[x * scale + s] = row[x];
+        }
+        out += dst_pitch;
+
+        for (int s = 1; s < scale; ++s, out += dst_pitch)
+            memcpy(out, first_line, width * scale * sizeof(uint32_t));
+    }
+}
+
+}
+
+void ExpandPixels(unsigned char const* src, int width, int height, uint32_t const palette[4],
+                  void* dst, int dst_pitch, int scale) {
+    static const ByteRowKernel kernel = PickByteRowKernel();
+    ExpandScaled(width, height, dst, dst_pitch, scale, [&](int y, uint32_t* out) {
+        kernel(src + y * width, width, palette, out);
+    });
+}
+
+void ExpandPackedPixels(PackedRow const* plane0, PackedRow const* plane1, int width, int height, uint32_t const palette[4],
+                        void* dst, int dst_pitch, int scale) {
+    static const PackedRowKernel kernel = PickPackedRowKernel();
+    ExpandScaled(width, height, dst, dst_pitch, scale, [&](int y, uint32_t* out) {
+        kernel(plane0 + y, plane1 ? plane1 + y : nullptr, width, palette, out);
+    });
+}
@@ -0,0 +1,19 @@
+#ifndef PIXEL_EXPAND_H
+#define PIXEL_EXPAND_H
+
+#include <cstdint>
+
+// One packed display row: 128 pixels, bit 127 is the leftmost pixel.
+using PackedRow = unsigned __int128;
+
+// Turns a byte per pixel framebuffer into 32-bit pixels. Each source byte is a palette index (0-3).
+// Every pixel is written scale x scale times, dst_pitch is in bytes so locked texture memory can be written directly.
+void ExpandPixels(unsigned char const* src, int width, int height, uint32_t const palette[4],
+                  void* dst, int dst_pitch, int scale = 1);
+
+// Same for packed bitplanes of height rows each. A pixel's palette index is its bit in plane0
+// plus twice its bit in plane1, pass nullptr as plane1 for a single plane.
+void ExpandPackedPixels(PackedRow const* plane0, PackedRow const* plane1, int width, int height, uint32_t const palette[4],
+                        void* dst, int dst_pitch, int scale = 1);
+
+#endif
@@ -1,28 +1,63 @@
 #include "platform.h"
+#include <cstring>
 
 Platform::Platform(char const* title, int window_width, int window_height, int texture_width, int texture_height) {
     SDL_Init(SDL_INIT_VIDEO);
     window = SDL_CreateWindow(title, 64, 32, 0);
     renderer = SDL_CreateRenderer(window, NULL);
+    SDL_SetRenderVSync(renderer, 1); // Present lands on the display refresh when the driver supports it.
     texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, texture_width, texture_height);
     SDL_SetWindowSize(window, 64 * window_width, 32 * window_height);
     SDL_SetTextureScaleMode(texture, SDL_SCALEMODE_NEAREST);
+    SetKeymap("X123QWEASDZC4RFV");
 }
 
-void Platform::Update(void const* buffer) {
-    // Convert pixels to 32-bit color.
-    uint32_t pixels[64 * 32];
-    const unsigned char* gfx = static_cast<const unsigned char*>(buffer);
-    for (int i = 0; i < 64 * 32; ++i)
-        pixels[i] = gfx[i] ? 0xFFFFFFFF : 0xFF000000; // 2 colors, white or black.
+void Platform::Update(PackedRow const* plane0, PackedRow const* plane1, int width, int height) {
+    // Resolution changed (SUPER-CHIP 00FE/00FF), only the texture has to follow.
+    if (texture->w != width || texture->h != height) {
+        SDL_DestroyTexture(texture);
+        texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, width, height);
+        SDL_SetTextureScaleMode(texture, SDL_SCALEMODE_NEAREST);
+    }
+
+    // Convert pixels to 32-bit color, straight into the texture.
+    void* pixels;
+    int pitch;
+    if (SDL_LockTexture(texture, nullptr, &pixels, &pitch)) {
+        ExpandPackedPixels(plane0, plane1, width, height, palette, pixels, pitch);
+        SDL_UnlockTexture(texture);
+    }
 
-    SDL_UpdateTexture(texture, nullptr, pixels, 64 * sizeof(uint32_t));
     SDL_RenderClear(renderer);
     SDL_RenderTexture(renderer, texture, nullptr, nullptr);
     SDL_RenderPresent(renderer);
 }
 
-bool Platform::ProcessInput(unsigned char* keys) {
+void Platform::SetPalette(uint32_t const colors[4]) {
+    memcpy(palette, colors, sizeof(palette));
+}
+
+// Layout is 16 key names, one per keypad key from 0 to F, e.g. "X123QWEASDZC4RFV".
+bool Platform::SetKeymap(char const* layout) {
+    signed char new_keymap[SDL_SCANCODE_COUNT];
+    memset(new_keymap, -1, sizeof(new_keymap));
+
+    if (SDL_strlen(layout) != 16)
+        return false;
+
+    for (int i = 0; i < 16; ++i) {
+        char name[2] = { layout[i], '\0' };
+        SDL_Scancode scancode = SDL_GetScancodeFromName(name);
+        if (scancode == SDL_SCANCODE_UNKNOWN)
+            return false;
+        new_keymap[scancode] = i;
+    }
+
+    memcpy(keymap, new_keymap, sizeof(keymap));
+    return true;
+}
+
+bool Platform::ProcessInput(KeyEventQueue& queue) {
     bool quit = false;
     SDL_Event event;
 
@@ -33,149 +68,27 @@ bool Platform::ProcessInput(unsigned char* keys) {
             break;
 
             case SDL_EVENT_KEY_DOWN:
-                switch (event.key.key) {
-                    case SDLK_ESCAPE:
-                        quit = true;
-                    break;
-
-                    case SDLK_X:
-                        keys[0] = 1;
-                    break;
-
-                    case SDLK_1:
-                        keys[1] = 1;
-                    break;
-
-                    case SDLK_2:
-                        keys[2] = 1;
-                    break;
-
-                    case SDLK_3:
-                        keys[3] = 1;
-                    break;
-
-                    case SDLK_Q:
-                        keys[4] = 1;
-                    break;
-
-                    case SDLK_W:
-                        keys[5] = 1;
-                    break;
-
-                    case SDLK_E:
-                        keys[6] = 1;
-                    break;
-
-                    case SDLK_A:
-                        keys[7] = 1;
-                    break;
-
-                    case SDLK_S:
-                        keys[8] = 1;
-                    break;
-
-                    case SDLK_D:
-                        keys[9] = 1;
-                    break;
-
-                    case SDLK_Z:
-                        keys[0xA] = 1;
-                    break;
-
-                    case SDLK_C:
-                        keys[0xB] = 1;
-                    break;
-
-                    case SDLK_4:
-                        keys[0xC] = 1;
-                    break;
-
-                    case SDLK_R:
-                        keys[0xD] = 1;
-                    break;
-
-                    case SDLK_F:
-                        keys[0xE] = 1;
-                    break;
-
-                    case SDLK_V:
-                        keys[0xF] = 1;
-                    break;
-
-                    default:
-                    break;
+            case SDL_EVENT_KEY_UP: {
+                if (event.key.down && event.key.scancode == SDL_SCANCODE_ESCAPE)
+                    quit = true;
+
+                // F1 halves the speed, F2 doubles it, F3 goes back to normal and F4 toggles fast-forward.
+                if (event.key.down && !event.key.repeat && hotkey_handler) {
+                    if (event.key.scancode == SDL_SCANCODE_F1)
+                        hotkey_handler(Hotkey::Slower);
+                    else if (event.key.scancode == SDL_SCANCODE_F2)
+                        hotkey_handler(Hotkey::Faster);
+                    else if (event.key.scancode == SDL_SCANCODE_F3)
+                        hotkey_handler(Hotkey::NormalSpeed);
+                    else if (event.key.scancode == SDL_SCANCODE_F4)
+                        hotkey_handler(Hotkey::Turbo);
                 }
-            break;
-
-            case SDL_EVENT_KEY_UP:
-                switch (event.key.key) {
-                    case SDLK_X:
-                        keys[0] = 0;
-                    break;
-
-                    case SDLK_1:
-                        keys[1] = 0;
-                    break;
-
-                    case SDLK_2:
-                        keys[2] = 0;
-                    break;
-
-                    case SDLK_3:
-                        keys[3] = 0;
-                    break;
-
-                    case SDLK_Q:
-                        keys[4] = 0;
-                    break;
-
-                    case SDLK_W:
-                        keys[5] = 0;
-                    break;
-
-                    case SDLK_E:
-                        keys[6] = 0;
-                    break;
-
-                    case SDLK_A:
-                        keys[7] = 0;
-                    break;
-
-                    case SDLK_S:
-                        keys[8] = 0;
-                    break;
 
-                    case SDLK_D:
-                        keys[9] = 0;
-                    break;
-
-                    case SDLK_Z:
-                        keys[0xA] = 0;
-                    break;
-
-                    case SDLK_C:
-                        keys[0xB] = 0;
-                    break;
-
-                    case SDLK_4:
-                        keys[0xC] = 0;
-                    break;
-
-                    case SDLK_R:
-                        keys[0xD] = 0;
-                    break;
-
-                    case SDLK_F:
-                        keys[0xE] = 0;
-                    break;
-
-                    case SDLK_V:
-                        keys[0xF] = 0;
-                    break;
-
-                    default:
-                    break;
-                }
+                // Ignore auto repeat, the keypad only cares about transitions.
+                signed char index = keymap[event.key.scancode];
+                if (index >= 0 && !event.key.repeat)
+                    queue.Push({ event.key.timestamp, static_cast<uint8_t>(index), event.key.down });
+            }
             break;
 
             default:
@@ -186,6 +99,16 @@ bool Platform::ProcessInput(unsigned char* keys) {
     return quit;
 }
 
+void Platform::WaitForEvent(int timeout_ms) {
+    SDL_WaitEventTimeout(nullptr, timeout_ms);
+}
+
+void Platform::Wake() {
+    SDL_Event event = {};
+    event.type = SDL_EVENT_USER;
+    SDL_PushEvent(&event);
+}
+
 Platform::~Platform() {
     SDL_DestroyTexture(texture);
     SDL_DestroyRenderer(renderer);
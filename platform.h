@@ -2,18 +2,32 @@
 #define platform
 
 #include <SDL3/SDL.h>
+#include <functional>
+#include "input_queue.h"
+#include "pixel_expand.h"
+
+// Emulator controls on the function keys, outside the keypad map.
+enum class Hotkey { Slower, Faster, NormalSpeed, Turbo };
 
 class Platform {
 public:
     Platform(char const* title, int windo_width, int window_height, int texture_width, int texture_height);
-    void Update(void const* buffer);
-    bool ProcessInput(unsigned char* keys);
+    void Update(PackedRow const* plane0, PackedRow const* plane1, int width, int height);
+    bool ProcessInput(KeyEventQueue& queue);
+    void WaitForEvent(int timeout_ms);
+    void Wake(); // Ends a WaitForEvent, from any thread.
+    bool SetKeymap(char const* layout);
+    void SetPalette(uint32_t const colors[4]);
+    void SetHotkeyHandler(std::function<void(Hotkey)> handler) { hotkey_handler = handler; } // Called from ProcessInput.
     ~Platform();
 
 private:
     SDL_Window* window{};
     SDL_Renderer* renderer{};
     SDL_Texture* texture{};
+    uint32_t palette[4] = { 0x000000FF, 0xFFFFFFFF, 0xAAAAAAFF, 0x555555FF }; // RGBA8888, background first.
+    signed char keymap[SDL_SCANCODE_COUNT]; // Scancode to keypad index, -1 if unmapped.
+    std::function<void(Hotkey)> hotkey_handler;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,192 @@
+#include "ram_search.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include "simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RAM_SEARCH_X86
+#endif
+
+namespace {
+
+// Ands the match mask of 32 bytes into each candidate word. Words with no candidates left are skipped.
+using FilterKernel = void (*)(unsigned char const* current, unsigned char const* previous, uint8_t value, uint32_t* words, size_t count);
+
+// The relations that are the opposite of a byte compare are computed as that compare, then inverted.
+constexpr bool Inverted(RamRelation relation) {
+    return relation == RamRelation::NotEqual || relation == RamRelation::Changed
+        || relation == RamRelation::Increased || relation == RamRelation::Decreased;
+}
+
+template <RamRelation R>
+void FilterScalar(unsigned char const* current, unsigned char const* previous, uint8_t value, uint32_t* words, size_t count) {
+    for (size_t w = 0; w < count; ++w) {
+        if (!words[w])
+            continue;
+
+        uint32_t mask = 0;
+        for (int i = 0; i < 32; ++i) {
+            uint8_t now = current[w * 32 + i];
+            uint8_t before = previous[w * 32 + i];
+            bool match = false;
+            switch (R) {
+                case RamRelation::Equal: case RamRelation::NotEqual: match = now == value; break;
+                case RamRelation::Changed: case RamRelation::Unchanged: match = now == before; break;
+                case RamRelation::Increased: match = now <= before; break;
+                case RamRelation::Decreased: match = now >= before; break;
+                case RamRelation::IncreasedBy: match = static_cast<uint8_t>(now - before) == value; break;
+                case RamRelation::DecreasedBy: match = static_cast<uint8_t>(before - now) == value; break;
+            }
+            mask |= static_cast<uint32_t>(match) << i;
+        }
+        words[w] &= Inverted(R) ? ~mask : mask;
+    }
+}
+
+#ifdef RAM_SEARCH_X86
+
+// Increased is "the saturating difference now - before is not zero", Decreased the other way round.
+template <RamRelation R>
+inline __m128i Compare(__m128i now, __m128i before, __m128i value) {
+    switch (R) {
+        case RamRelation::Equal: case RamRelation::NotEqual: return _mm_cmpeq_epi8(now, value);
+        case RamRelation::Changed: case RamRelation::Unchanged: return _mm_cmpeq_epi8(now, before);
+        case RamRelation::Increased: return _mm_cmpeq_epi8(_mm_subs_epu8(now, before), _mm_setzero_si128());
+        case RamRelation::Decreased: return _mm_cmpeq_epi8(_mm_subs_epu8(before, now), _mm_setzero_si128());
+        case RamRelation::IncreasedBy: return _mm_cmpeq_epi8(_mm_sub_epi8(now, before), value);
+        case RamRelation::DecreasedBy: return _mm_cmpeq_epi8(_mm_sub_epi8(before, now), value);
+    }
+    return now;
+}
+
+template <RamRelation R>
+void FilterSSE2(unsigned char const* current, unsigned char const* previous, uint8_t value, uint32_t* words, size_t count) {
+    __m128i values = _mm_set1_epi8(static_cast<char>(value));
+    for (size_t w = 0; w < count; ++w) {
+        if (!words[w])
+            continue;
+
+        __m128i const* now = reinterpret_cast<__m128i const*>(current + w * 32);
+        __m128i const* before = reinterpret_cast<__m128i const*>(previous + w * 32);
+        uint32_t low = static_cast<uint32_t>(_mm_movemask_epi8(Compare<R>(_mm_loadu_si128(now), _mm_loadu_si128(before), values)));
+        uint32_t high = static_cast<uint32_t>(_mm_movemask_epi8(Compare<R>(_mm_loadu_si128(now + 1), _mm_loadu_si128(before + 1), values)));
+        uint32_t mask = low | high << 16;
+        words[w] &= Inverted(R) ? ~mask : mask;
+    }
+}
+
+template <RamRelation R>
+__attribute__((target("avx2")))
+inline __m256i Compare256(__m256i now, __m256i before, __m256i value) {
+    switch (R) {
+        case RamRelation::Equal: case RamRelation::NotEqual: return _mm256_cmpeq_epi8(now, value);
+        case RamRelation::Changed: case RamRelation::Unchanged: return _mm256_cmpeq_epi8(now, before);
+        case RamRelation::Increased: return _mm256_cmpeq_epi8(_mm256_subs_epu8(now, before), _mm256_setzero_si256());
+        case RamRelation::Decreased: return _mm256_cmpeq_epi8(_mm256_subs_epu8(before, now), _mm256_setzero_si256());
+        case RamRelation::IncreasedBy: return _mm256_cmpeq_epi8(_mm256_sub_epi8(now, before), value);
+        case RamRelation::DecreasedBy: return _mm256_cmpeq_epi8(_mm256_sub_epi8(before, now), value);
+    }
+    return now;
+}
+
+// One candidate word is exactly one 32 byte compare.
+template <RamRelation R>
+__attribute__((target("avx2")))
+void FilterAVX2(unsigned char const* current, unsigned char const* previous, uint8_t value, uint32_t* words, size_t count) {
+    __m256i values = _mm256_set1_epi8(static_cast<char>(value));
+    for (size_t w = 0; w < count; ++w) {
+        if (!words[w])
+            continue;
+
+        __m256i now = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(current + w * 32));
+        __m256i before = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(previous + w * 32));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(Compare256<R>(now, before, values)));
+        words[w] &= Inverted(R) ? ~mask : mask;
+    }
+}
+
+#endif
+
+template <RamRelation R>
+FilterKernel PickKernel() {
+#ifdef RAM_SEARCH_X86
+    if (GetSimdLevel() == SimdLevel::AVX2)
+        return FilterAVX2<R>;
+    if (GetSimdLevel() == SimdLevel::SSE2)
+        return FilterSSE2<R>;
+#endif
+    return FilterScalar<R>;
+}
+
+FilterKernel KernelFor(RamRelation relation) {
+    switch (relation) {
+        case RamRelation::Equal: return PickKernel<RamRelation::Equal>();
+        case RamRelation::NotEqual: return PickKernel<RamRelation::NotEqual>();
+        case RamRelation::Changed: return PickKernel<RamRelation::Changed>();
+        case RamRelation::Unchanged: return PickKernel<RamRelation::Unchanged>();
+        case RamRelation::Increased: return PickKernel<RamRelation::Increased>();
+        case RamRelation::Decreased: return PickKernel<RamRelation::Decreased>();
+        case RamRelation::IncreasedBy: return PickKernel<RamRelation::IncreasedBy>();
+        case RamRelation::DecreasedBy: return PickKernel<RamRelation::DecreasedBy>();
+    }
+    return FilterScalar<RamRelation::Equal>;
+}
+
+const size_t CHUNK_WORDS = 128; // 4 KB of memory per task.
+const size_t BYTES_PER_THREAD = 256 * 1024; // Less work than this per thread isn't worth starting one.
+
+}
+
+void RamSearch::Start(std::vector<unsigned char const*> const& memories, size_t memory_size) {
+    size = memory_size / 32 * 32;
+    candidates.assign(size / 32, ~0u);
+    previous.assign(memories.size(), std::vector<unsigned char>(size));
+    for (size_t i = 0; i < memories.size(); ++i)
+        memcpy(previous[i].data(), memories[i], size);
+}
+
+// Address chunks are independent, each thread filters and snapshots its chunks in every instance.
+size_t RamSearch::Filter(std::vector<unsigned char const*> const& memories, RamRelation relation, uint8_t value) {
+    FilterKernel kernel = KernelFor(relation);
+    size_t instances = std::min(memories.size(), previous.size());
+    size_t chunks = (candidates.size() + CHUNK_WORDS - 1) / CHUNK_WORDS;
+
+    auto filter_chunks = [&](size_t first, size_t step) {
+        for (size_t chunk = first; chunk < chunks; chunk += step) {
+            size_t word = chunk * CHUNK_WORDS;
+            size_t count = std::min(CHUNK_WORDS, candidates.size() - word);
+            for (size_t i = 0; i < instances; ++i) {
+                kernel(memories[i] + word * 32, previous[i].data() + word * 32, value, candidates.data() + word, count);
+                memcpy(previous[i].data() + word * 32, memories[i] + word * 32, count * 32);
+            }
+        }
+    };
+
+    size_t threads = std::min<size_t>({ std::max(1u, std::thread::hardware_concurrency()), chunks,
+                                        std::max<size_t>(1, instances * size / BYTES_PER_THREAD) });
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < threads; ++t)
+        workers.emplace_back(filter_chunks, t, threads);
+    filter_chunks(0, threads);
+    for (std::thread& worker : workers)
+        worker.join();
+
+    return Count();
+}
+
+size_t RamSearch::Count() const {
+    size_t count = 0;
+    for (uint32_t word : candidates)
+        count += __builtin_popcount(word);
+    return count;
+}
+
+std::vector<uint16_t> RamSearch::Candidates() const {
+    std::vector<uint16_t> addresses;
+    for (size_t w = 0; w < candidates.size(); ++w)
+        for (uint32_t bits = candidates[w]; bits; bits &= bits - 1)
+            addresses.push_back(static_cast<uint16_t>(w * 32 + __builtin_ctz(bits)));
+    return addresses;
+}
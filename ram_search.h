@@ -0,0 +1,33 @@
+#ifndef RAM_SEARCH_H
+#define RAM_SEARCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// How a byte must relate to its previous snapshot, or to a value, to stay a candidate.
+enum class RamRelation { Equal, NotEqual, Changed, Unchanged, Increased, Decreased, IncreasedBy, DecreasedBy };
+
+// Narrows down where a ROM keeps a variable by filtering memory across successive snapshots.
+// Several instances, e.g. input branches of one ROM, are filtered together: an address survives
+// only if the relation holds in every one of them.
+class RamSearch {
+public:
+    // Every address below size is a candidate again. Each memory is snapshotted as the first previous value.
+    void Start(std::vector<unsigned char const*> const& memories, size_t size);
+
+    // Keeps candidates where relation holds between each current memory and its previous snapshot,
+    // value is the compare value or the step for IncreasedBy and DecreasedBy. Returns the candidates left.
+    size_t Filter(std::vector<unsigned char const*> const& memories, RamRelation relation, uint8_t value = 0);
+
+    size_t Count() const;
+    std::vector<uint16_t> Candidates() const;
+    uint8_t Previous(size_t instance, uint16_t address) const { return previous[instance][address]; }
+
+private:
+    size_t size = 0;
+    std::vector<uint32_t> candidates; // One bit per address, 32 addresses per word.
+    std::vector<std::vector<unsigned char>> previous;
+};
+
+#endif
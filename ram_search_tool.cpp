@@ -0,0 +1,151 @@
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "chip8.h"
+#include "ram_search.h"
+#include "romdb.h"
+
+namespace {
+
+const int FRAME_HZ = 60;
+
+struct Instance {
+    std::unique_ptr<chip8> machine;
+    uint16_t held = 0; // Keypad bitmask held while running.
+};
+
+std::vector<unsigned char const*> Memories(std::vector<Instance>& instances) {
+    std::vector<unsigned char const*> memories;
+    for (Instance& instance : instances)
+        memories.push_back(instance.machine->GetMemoryData());
+    return memories;
+}
+
+void PrintHelp() {
+    std::cout << "  branches <n>             Copy instance 0 into n instances, restarts the search\n"
+              << "  hold <instance> <keys>   Hex keys held by an instance while running, - for none\n"
+              << "  run <frames>             Run every instance\n"
+              << "  eq|ne <value>            Compare with a value\n"
+              << "  changed|unchanged        Compare with the last snapshot\n"
+              << "  inc|dec [n]              Increased or decreased since the last snapshot, by exactly n if given\n"
+              << "  list [n]                 Show up to n candidates with their values, default 32\n"
+              << "  restart                  Every address is a candidate again\n"
+              << "  quit\n";
+}
+
+}
+
+// Interactive RAM search: run instances of a ROM with different held keys and filter memory
+// between runs until only the variable you are looking for is left.
+int main(int argc, char **argv) {
+    char const* machine_name = nullptr;
+    int cycles_per_frame = 0;
+    int arg = 1;
+
+    for (; arg < argc && argv[arg][0] == '-'; ++arg) {
+        if (strcmp(argv[arg], "--machine") == 0 && arg + 1 < argc)
+            machine_name = argv[++arg];
+        else if (strcmp(argv[arg], "--cycles") == 0 && arg + 1 < argc)
+            cycles_per_frame = std::stoi(argv[++arg]);
+        else
+            break;
+    }
+
+    if (arg + 1 != argc) {
+        std::cerr << "Usage: " << argv[0] << " [--machine chip8|schip|xochip] [--cycles <n>] <ROM>\n"
+                  << "Then commands on stdin:\n";
+        PrintHelp();
+        return 1;
+    }
+
+    std::vector<Instance> instances(1);
+    instances[0].machine.reset(new chip8);
+    chip8& first = *instances[0].machine;
+    first.Initialize();
+    first.SetSeed(1);
+    first.LoadGame(argv[arg]);
+
+    MachineSetup setup;
+    if (!ResolveMachine(first.GetRomSha1(), machine_name, cycles_per_frame, setup))
+        return 1;
+    first.SetQuirks(setup.quirks);
+    cycles_per_frame = setup.cycles_per_frame;
+    first.SetCyclesPerSecond(cycles_per_frame ? cycles_per_frame * FRAME_HZ : 500);
+
+    // Only XO-CHIP ROMs can reach past 4K.
+    size_t memory_size = setup.machine == Machine::XOChip ? 65536 : 4096;
+    RamSearch search;
+    search.Start(Memories(instances), memory_size);
+
+    std::string line;
+    while (std::cout << "> " << std::flush, std::getline(std::cin, line)) {
+        std::istringstream words(line);
+        std::string command;
+        if (!(words >> command))
+            continue;
+
+        unsigned value = 0;
+        bool has_value = static_cast<bool>(words >> value);
+
+        if (command == "quit")
+            break;
+        else if (command == "branches" && has_value && value > 0) {
+            instances.resize(value);
+            for (size_t i = 1; i < instances.size(); ++i)
+                instances[i].machine.reset(new chip8(*instances[0].machine));
+            search.Start(Memories(instances), memory_size);
+        }
+        else if (command == "hold" && has_value && value < instances.size()) {
+            std::string keys;
+            words >> keys;
+            instances[value].held = 0;
+            for (char key : keys)
+                if (isxdigit(key))
+                    instances[value].held |= 1 << std::stoi(std::string(1, key), nullptr, 16);
+        }
+        else if (command == "run" && has_value) {
+            for (Instance& instance : instances) {
+                instance.machine->keypad.Set(instance.held);
+                instance.machine->RunFrames(static_cast<int>(value), 0, 0);
+            }
+        }
+        else if (command == "list") {
+            std::vector<uint16_t> candidates = search.Candidates();
+            for (size_t i = 0; i < candidates.size() && i < (has_value ? value : 32); ++i) {
+                printf("%04X", candidates[i]);
+                for (size_t n = 0; n < instances.size(); ++n)
+                    printf(" %02X", search.Previous(n, candidates[i]));
+                printf("\n");
+            }
+            fflush(stdout);
+        }
+        else if (command == "restart")
+            search.Start(Memories(instances), memory_size);
+        else {
+            RamRelation relation;
+            if (command == "eq" && has_value)
+                relation = RamRelation::Equal;
+            else if (command == "ne" && has_value)
+                relation = RamRelation::NotEqual;
+            else if (command == "changed")
+                relation = RamRelation::Changed;
+            else if (command == "unchanged")
+                relation = RamRelation::Unchanged;
+            else if (command == "inc")
+                relation = has_value ? RamRelation::IncreasedBy : RamRelation::Increased;
+            else if (command == "dec")
+                relation = has_value ? RamRelation::DecreasedBy : RamRelation::Decreased;
+            else {
+                PrintHelp();
+                continue;
+            }
+            std::cout << search.Filter(Memories(instances), relation, static_cast<uint8_t>(value)) << " candidates\n";
+        }
+    }
+
+    return 0;
+}
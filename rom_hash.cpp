@@ -0,0 +1,118 @@
+#include "rom_hash.h"
+#include <cstring>
+
+namespace {
+
+const uint64_t PRIME_1 = 0x9E3779B185EBCA87ULL;
+const uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+
+inline uint64_t Rotate(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// Final avalanche so every input bit affects every output bit.
+inline uint64_t Mix(uint64_t value) {
+    value ^= value >> 33;
+    value *= PRIME_2;
+    value ^= value >> 29;
+    value *= PRIME_1;
+    value ^= value >> 32;
+    return value;
+}
+
+}
+
+uint64_t HashRom(void const* data, size_t size) {
+    unsigned char const* bytes = static_cast<unsigned char const*>(data);
+    uint64_t hash = PRIME_1 ^ (size * PRIME_2);
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        hash = Rotate(hash ^ (word * PRIME_2), 31) * PRIME_1;
+    }
+
+    uint64_t tail = 0;
+    memcpy(&tail, bytes + i, size - i);
+    hash = Rotate(hash ^ (tail * PRIME_2), 31) * PRIME_1;
+
+    return Mix(hash);
+}
+
+namespace {
+
+inline uint32_t Rotate32(uint32_t value, int bits) {
+    return (value << bits) | (value >> (32 - bits));
+}
+
+void Sha1Block(uint32_t state[5], unsigned char const* block) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; ++i)
+        w[i] = uint32_t(block[i * 4]) << 24 | uint32_t(block[i * 4 + 1]) << 16 | uint32_t(block[i * 4 + 2]) << 8 | block[i * 4 + 3];
+    for (int i = 16; i < 80; ++i)
+        w[i] = Rotate32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+    for (int i = 0; i < 80; ++i) {
+        uint32_t f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        }
+        else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        }
+        else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        }
+        else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+
+        uint32_t temp = Rotate32(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = Rotate32(b, 30);
+        b = a;
+        a = temp;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+}
+
+void Sha1Rom(void const* data, size_t size, unsigned char digest[20]) {
+    unsigned char const* bytes = static_cast<unsigned char const*>(data);
+    uint32_t state[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64)
+        Sha1Block(state, bytes + i);
+
+    // Padding: a one bit, zeros, then the length in bits, big endian.
+    unsigned char tail[128] = {};
+    size_t remaining = size - i;
+    memcpy(tail, bytes + i, remaining);
+    tail[remaining] = 0x80;
+    size_t tail_size = remaining < 56 ? 64 : 128;
+    uint64_t bits = static_cast<uint64_t>(size) * 8;
+    for (int b = 0; b < 8; ++b)
+        tail[tail_size - 1 - b] = static_cast<unsigned char>(bits >> (8 * b));
+
+    Sha1Block(state, tail);
+    if (tail_size == 128)
+        Sha1Block(state, tail + 64);
+
+    for (int w = 0; w < 5; ++w)
+        for (int b = 0; b < 4; ++b)
+            digest[w * 4 + b] = static_cast<unsigned char>(state[w] >> (24 - 8 * b));
+}
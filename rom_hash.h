@@ -0,0 +1,13 @@
+#ifndef ROM_HASH_H
+#define ROM_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Fast non-cryptographic 64-bit hash of a ROM image, reads 8 bytes per step.
+uint64_t HashRom(void const* data, size_t size);
+
+// SHA-1 of a ROM image, the key community ROM databases use.
+void Sha1Rom(void const* data, size_t size, unsigned char digest[20]);
+
+#endif
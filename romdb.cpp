@@ -0,0 +1,84 @@
+#include "romdb.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+constexpr unsigned char HexDigit(char c) {
+    return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+}
+
+// Turns the hex string of an entry into bytes at compile time, so the table is plain read-only data.
+constexpr RomInfo MakeEntry(char const (&sha1)[41], Machine machine, uint16_t cycles_per_frame, char const* title) {
+    RomInfo info{ {}, machine, cycles_per_frame, title };
+    for (int i = 0; i < 20; ++i)
+        info.sha1[i] = HexDigit(sha1[i * 2]) << 4 | HexDigit(sha1[i * 2 + 1]);
+    return info;
+}
+
+#define ROMDB_ENTRY(sha1, machine, cycles_per_frame, title) MakeEntry(sha1, machine, cycles_per_frame, title),
+
+// The last entry is a terminator so the table is never empty.
+constexpr RomInfo ROMDB[] = {
+#include "romdb.inc"
+    { {}, Machine::Chip8, 0, nullptr }
+};
+
+#undef ROMDB_ENTRY
+
+constexpr size_t ROMDB_SIZE = sizeof(ROMDB) / sizeof(ROMDB[0]) - 1;
+
+constexpr bool Sha1Less(RomInfo const& a, RomInfo const& b) {
+    for (int i = 0; i < 20; ++i)
+        if (a.sha1[i] != b.sha1[i])
+            return a.sha1[i] < b.sha1[i];
+    return false;
+}
+
+static_assert(std::is_sorted(ROMDB, ROMDB + ROMDB_SIZE, Sha1Less), "romdb.inc must be sorted by SHA-1");
+
+struct MachineName {
+    char const* name;
+    Machine machine;
+};
+
+constexpr MachineName MACHINE_NAMES[] = {
+    { "chip8", Machine::Chip8 },
+    { "schip", Machine::SuperChip },
+    { "xochip", Machine::XOChip },
+};
+
+}
+
+RomInfo const* LookupRom(unsigned char const sha1[20]) {
+    RomInfo key{};
+    memcpy(key.sha1, sha1, sizeof(key.sha1));
+
+    RomInfo const* end = ROMDB + ROMDB_SIZE;
+    RomInfo const* entry = std::lower_bound(ROMDB, end, key, Sha1Less);
+    return entry != end && memcmp(entry->sha1, sha1, sizeof(key.sha1)) == 0 ? entry : nullptr;
+}
+
+bool ResolveMachine(unsigned char const sha1[20], char const* machine_name, int cycles_per_frame, MachineSetup& setup) {
+    RomInfo const* rom_info = LookupRom(sha1);
+    setup = MachineSetup();
+
+    if (machine_name) {
+        auto named = std::find_if(std::begin(MACHINE_NAMES), std::end(MACHINE_NAMES),
+                                  [&](MachineName const& entry) { return strcmp(entry.name, machine_name) == 0; });
+        if (named == std::end(MACHINE_NAMES)) {
+            std::cerr << "Unknown machine: " << machine_name << "\n";
+            return false;
+        }
+        setup.machine = named->machine;
+        setup.quirks = QuirksFor(setup.machine);
+    }
+    else if (rom_info) {
+        setup.machine = rom_info->machine;
+        setup.quirks = QuirksFor(setup.machine);
+    }
+
+    setup.cycles_per_frame = cycles_per_frame ? cycles_per_frame : rom_info ? rom_info->cycles_per_frame : 0;
+    return true;
+}
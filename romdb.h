@@ -0,0 +1,29 @@
+#ifndef ROMDB_H
+#define ROMDB_H
+
+#include <cstdint>
+#include "chip8.h"
+
+// What we know about a ROM: the machine it was written for and how fast it should run.
+struct RomInfo {
+    unsigned char sha1[20];
+    Machine machine;
+    uint16_t cycles_per_frame;
+    char const* title;
+};
+
+// Binary search of the bundled database by SHA-1, nullptr if the ROM is unknown.
+RomInfo const* LookupRom(unsigned char const sha1[20]);
+
+// How to run a ROM: what the command line says, otherwise what the database says.
+struct MachineSetup {
+    Machine machine = Machine::Chip8;
+    Quirks quirks; // Unknown ROMs keep the default quirks.
+    int cycles_per_frame = 0; // 0 when neither knows, each tool has its own default.
+};
+
+// Setup for a loaded ROM. machine_name is chip8, schip, xochip or nullptr, cycles_per_frame 0 if not given.
+// An unknown machine name is reported to std::cerr and returns false.
+bool ResolveMachine(unsigned char const sha1[20], char const* machine_name, int cycles_per_frame, MachineSetup& setup);
+
+#endif
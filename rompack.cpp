@@ -0,0 +1,113 @@
+#include "rompack.h"
+#include "rom_hash.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <unordered_set>
+
+static const char ROMPACK_MAGIC[8] = "C8PACK1";
+
+bool RomPack::Open(char const* filename) {
+    header = nullptr;
+    entries = nullptr;
+
+    if (!file.Open(filename) || file.Size() < sizeof(RomPackHeader))
+        return false;
+
+    RomPackHeader const* candidate = reinterpret_cast<RomPackHeader const*>(file.Data());
+    if (memcmp(candidate->magic, ROMPACK_MAGIC, sizeof(ROMPACK_MAGIC)) != 0)
+        return false;
+
+    // Validate the index once so lookups don't have to.
+    size_t index_end = sizeof(RomPackHeader) + candidate->count * sizeof(RomPackEntry);
+    if (index_end > file.Size() || candidate->names_offset > file.Size())
+        return false;
+
+    RomPackEntry const* index = reinterpret_cast<RomPackEntry const*>(file.Data() + sizeof(RomPackHeader));
+    for (uint32_t i = 0; i < candidate->count; ++i) {
+        // Compared so that a huge offset can't wrap around to a small end.
+        if (index[i].offset > file.Size() || index[i].size > file.Size() - index[i].offset)
+            return false;
+
+        // The name has to end inside the file too.
+        size_t name = candidate->names_offset + index[i].name_offset;
+        if (name >= file.Size() || !memchr(file.Data() + name, 0, file.Size() - name))
+            return false;
+    }
+
+    header = candidate;
+    entries = index;
+    return true;
+}
+
+RomPackEntry const* RomPack::Find(uint64_t hash) const {
+    RomPackEntry const* end = entries + Count();
+    RomPackEntry const* entry = std::lower_bound(entries, end, hash, [](RomPackEntry const& e, uint64_t h) { return e.hash < h; });
+    return entry != end && entry->hash == hash ? entry : nullptr;
+}
+
+RomPackEntry const* RomPack::FindByName(char const* name) const {
+    for (uint32_t i = 0; i < Count(); ++i)
+        if (strcmp(Name(entries[i]), name) == 0)
+            return &entries[i];
+    return nullptr;
+}
+
+char const* RomPack::Name(RomPackEntry const& entry) const {
+    return reinterpret_cast<char const*>(file.Data() + header->names_offset + entry.name_offset);
+}
+
+bool RomPack::Build(char const* filename, std::vector<Input> const& roms) {
+    std::vector<RomPackEntry> index;
+    std::vector<Input const*> blobs;
+    std::string names;
+    std::unordered_set<uint64_t> seen;
+
+    for (Input const& rom : roms) {
+        uint64_t hash = HashRom(rom.data.data(), rom.data.size());
+        if (!seen.insert(hash).second)
+            continue;
+
+        index.push_back({ hash, 0, static_cast<uint32_t>(rom.data.size()), static_cast<uint32_t>(names.size()) });
+        blobs.push_back(&rom);
+        names += rom.name;
+        names += '\0';
+    }
+
+    // Blobs are laid out in index order, right after the index.
+    std::vector<size_t> order(index.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return index[a].hash < index[b].hash; });
+
+    std::vector<RomPackEntry> sorted_index;
+    std::vector<Input const*> sorted_blobs;
+    uint64_t offset = sizeof(RomPackHeader) + index.size() * sizeof(RomPackEntry);
+    for (size_t i : order) {
+        offset = (offset + ROMPACK_ALIGN - 1) / ROMPACK_ALIGN * ROMPACK_ALIGN;
+        sorted_index.push_back(index[i]);
+        sorted_index.back().offset = offset;
+        sorted_blobs.push_back(blobs[i]);
+        offset += index[i].size;
+    }
+
+    RomPackHeader header{};
+    memcpy(header.magic, ROMPACK_MAGIC, sizeof(ROMPACK_MAGIC));
+    header.count = static_cast<uint32_t>(sorted_index.size());
+    header.names_offset = offset;
+
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+        return false;
+
+    out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+    out.write(reinterpret_cast<char const*>(sorted_index.data()), sorted_index.size() * sizeof(RomPackEntry));
+    for (size_t i = 0; i < sorted_index.size(); ++i) {
+        static const char padding[ROMPACK_ALIGN] = {};
+        out.write(padding, sorted_index[i].offset - out.tellp());
+        out.write(reinterpret_cast<char const*>(sorted_blobs[i]->data.data()), sorted_blobs[i]->data.size());
+    }
+    out.write(names.data(), names.size());
+
+    return out.good();
+}
@@ -0,0 +1,50 @@
+#ifndef ROMPACK_H
+#define ROMPACK_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "mapped_file.h"
+
+// ROM pack archive, mapped once and shared by every job.
+// Layout: header, index sorted by hash, ROM blobs aligned to ROMPACK_ALIGN, then the name table.
+struct RomPackHeader {
+    char magic[8]; // "C8PACK1"
+    uint32_t count;
+    uint32_t reserved;
+    uint64_t names_offset;
+};
+
+struct RomPackEntry {
+    uint64_t hash; // HashRom of the blob.
+    uint64_t offset; // From the start of the file.
+    uint32_t size;
+    uint32_t name_offset; // From names_offset, zero terminated.
+};
+
+const int ROMPACK_ALIGN = 64;
+
+class RomPack {
+public:
+    bool Open(char const* filename);
+    uint32_t Count() const { return header ? header->count : 0; }
+    RomPackEntry const& Entry(uint32_t i) const { return entries[i]; }
+    RomPackEntry const* Find(uint64_t hash) const;
+    RomPackEntry const* FindByName(char const* name) const;
+    unsigned char const* Data(RomPackEntry const& entry) const { return file.Data() + entry.offset; }
+    char const* Name(RomPackEntry const& entry) const;
+
+    // Writes a pack holding every ROM, duplicates by hash are stored once.
+    struct Input {
+        std::string name;
+        std::vector<unsigned char> data;
+    };
+    static bool Build(char const* filename, std::vector<Input> const& roms);
+
+private:
+    MappedFile file;
+    RomPackHeader const* header = nullptr;
+    RomPackEntry const* entries = nullptr;
+};
+
+#endif
@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <utility>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "rom_hash.h"
+#include "rompack.h"
+
+// Builds ROM packs from a directory of ROMs and lists their contents.
+int main(int argc, char **argv) {
+    if (argc == 4 && strcmp(argv[1], "build") == 0) {
+        std::vector<RomPack::Input> roms;
+        for (auto const& entry : std::filesystem::recursive_directory_iterator(argv[2])) {
+            if (!entry.is_regular_file() || entry.file_size() == 0 || entry.file_size() > 65536 - 0x200)
+                continue;
+
+            std::ifstream file(entry.path(), std::ios::binary);
+            RomPack::Input rom;
+            rom.name = std::filesystem::relative(entry.path(), argv[2]).generic_string();
+            rom.data.resize(entry.file_size());
+            file.read(reinterpret_cast<char*>(rom.data.data()), rom.data.size());
+            roms.push_back(std::move(rom));
+        }
+
+        // Directory order is not stable, names keep the pack reproducible.
+        std::sort(roms.begin(), roms.end(), [](RomPack::Input const& a, RomPack::Input const& b) { return a.name < b.name; });
+
+        if (!RomPack::Build(argv[3], roms)) {
+            std::cerr << "Failed to write " << argv[3] << "\n";
+            return 1;
+        }
+        std::cout << "Packed " << roms.size() << " files (duplicates stored once) into " << argv[3] << "\n";
+        return 0;
+    }
+
+    if (argc == 3 && strcmp(argv[1], "list") == 0) {
+        RomPack pack;
+        if (!pack.Open(argv[2])) {
+            std::cerr << "Not a ROM pack: " << argv[2] << "\n";
+            return 1;
+        }
+        for (uint32_t i = 0; i < pack.Count(); ++i) {
+            RomPackEntry const& entry = pack.Entry(i);
+            printf("%016llX %6u %s\n", static_cast<unsigned long long>(entry.hash), entry.size, pack.Name(entry));
+        }
+        return 0;
+    }
+
+    // Database rows for romdb.inc, hashed from the ROM files themselves. The machine and speed are whatever the
+    // caller verified the ROMs run correctly with, there is no default to paste by accident.
+    if (argc >= 7 && strcmp(argv[1], "sha1") == 0 && strcmp(argv[2], "--machine") == 0 && strcmp(argv[4], "--cycles") == 0) {
+        const std::pair<char const*, char const*> MACHINES[] = {
+            { "chip8", "Machine::Chip8" },
+            { "schip", "Machine::SuperChip" },
+            { "xochip", "Machine::XOChip" },
+        };
+        auto machine = std::find_if(std::begin(MACHINES), std::end(MACHINES),
+                                    [&](auto const& entry) { return strcmp(entry.first, argv[3]) == 0; });
+        if (machine == std::end(MACHINES)) {
+            std::cerr << "Unknown machine: " << argv[3] << "\n";
+            return 1;
+        }
+        int cycles_per_frame = atoi(argv[5]);
+        if (cycles_per_frame <= 0 || cycles_per_frame > 65535) {
+            std::cerr << "Bad cycles per frame: " << argv[5] << "\n";
+            return 1;
+        }
+
+        for (int arg = 6; arg < argc; ++arg) {
+            std::ifstream file(argv[arg], std::ios::binary);
+            if (!file) {
+                std::cerr << "Failed to read " << argv[arg] << "\n";
+                return 1;
+            }
+            std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+            unsigned char sha1[20];
+            Sha1Rom(data.data(), data.size(), sha1);
+            printf("ROMDB_ENTRY(\"");
+            for (unsigned char byte : sha1)
+                printf("%02x", byte);
+            printf("\", %s, %d, \"%s\")\n", machine->second, cycles_per_frame, std::filesystem::path(argv[arg]).stem().string().c_str());
+        }
+        return 0;
+    }
+
+    std::cerr << "Usage: " << argv[0] << " build <ROM directory> <pack file>\n"
+              << "       " << argv[0] << " list <pack file>\n"
+              << "       " << argv[0] << " sha1 --machine <chip8|schip|xochip> --cycles <per frame> <ROM>...\n";
+    return 1;
+}
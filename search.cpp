@@ -0,0 +1,294 @@
+#include "search.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+
+const int FRAME_HZ = 60;
+
+// Tasks are dealt out to per-worker deques up front. A worker takes its own from the back and,
+// once it runs dry, steals from the front of the others. The calling thread is worker 0.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(int threads) : queues(threads) {
+        for (int i = 1; i < threads; ++i)
+            workers.emplace_back(&WorkStealingPool::WorkerLoop, this, i);
+    }
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    int Threads() const { return static_cast<int>(queues.size()); }
+
+    // Returns once every worker is done with this generation, so none of them can still be in body or a queue.
+    void Run(int tasks, std::function<void(int task, int worker)> task_body) {
+        for (int task = 0; task < tasks; ++task) {
+            Queue& queue = queues[static_cast<size_t>(task) * queues.size() / tasks];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.push_back(task);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            body = std::move(task_body);
+            busy = static_cast<int>(workers.size());
+            ++generation;
+        }
+        wake.notify_all();
+
+        Work(0);
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [&] { return busy == 0; });
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<int> tasks;
+    };
+
+    std::vector<Queue> queues;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    std::function<void(int, int)> body; // Only replaced while no worker is busy.
+    uint64_t generation = 0;
+    int busy = 0; // Workers that haven't finished the current generation yet.
+    bool stop = false;
+
+    bool Take(int worker, int& task) {
+        Queue& own = queues[worker];
+        {
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = own.tasks.back();
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+
+        for (size_t i = 1; i < queues.size(); ++i) {
+            Queue& victim = queues[(worker + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = victim.tasks.front();
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Work(int worker) {
+        for (int task; Take(worker, task);)
+            body(task, worker);
+    }
+
+    void WorkerLoop(int worker) {
+        uint64_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stop || generation != seen; });
+                if (stop)
+                    return;
+                seen = generation;
+            }
+
+            Work(worker);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--busy == 0)
+                idle.notify_all();
+        }
+    }
+};
+
+// Every state hash seen so far, with the smallest claim made on it. Claims order children by
+// depth, parent and action, so which duplicate survives doesn't depend on thread timing.
+class VisitedSet {
+public:
+    void Claim(uint64_t hash, uint64_t claim) {
+        Shard& shard = shards[hash % SHARDS];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto [it, inserted] = shard.claims.emplace(hash, claim);
+        if (!inserted && claim < it->second)
+            it->second = claim;
+    }
+
+    // Only called between expansions, when nothing is claiming.
+    bool Owns(uint64_t hash, uint64_t claim) const {
+        Shard const& shard = shards[hash % SHARDS];
+        auto it = shard.claims.find(hash);
+        return it != shard.claims.end() && it->second == claim;
+    }
+
+private:
+    static constexpr int SHARDS = 64;
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, uint64_t> claims;
+    };
+    Shard shards[SHARDS];
+};
+
+struct Node {
+    chip8 machine;
+    std::vector<int8_t> actions;
+};
+
+struct Child {
+    uint64_t claim; // Depth, parent index and action.
+    uint64_t hash;
+    int64_t score;
+};
+
+int64_t Score(chip8& machine, SearchGoal const& goal) {
+    switch (goal.kind) {
+        case SearchGoal::Bcd:
+            return machine.GetMemory(goal.address) * 100 + machine.GetMemory(goal.address + 1) * 10 + machine.GetMemory(goal.address + 2);
+
+        case SearchGoal::Byte:
+            return machine.GetMemory(goal.address);
+
+        case SearchGoal::Pattern: {
+            if (goal.pattern_width != machine.GetWidth() || goal.pattern_height != machine.GetHeight())
+                return -static_cast<int64_t>(goal.pattern.size());
+            int64_t differing = 0;
+            for (size_t i = 0; i < goal.pattern.size(); ++i)
+                differing += machine.GetGFX(static_cast<int>(i)) != goal.pattern[i];
+            return -differing;
+        }
+    }
+    return 0;
+}
+
+void ApplyAction(chip8& machine, int8_t action) {
+    machine.keypad.Set(action < 0 ? 0 : static_cast<uint16_t>(1 << action));
+}
+
+}
+
+SearchResult RunSearch(chip8 const& start, SearchGoal const& goal, SearchOptions const& options) {
+    auto started = std::chrono::steady_clock::now();
+    int cycles_per_second = options.cycles_per_frame ? options.cycles_per_frame * FRAME_HZ : 500;
+    int threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<int8_t> actions = { -1 };
+    for (uint8_t key : options.keys)
+        actions.push_back(static_cast<int8_t>(key & 0xF));
+    int action_count = static_cast<int>(actions.size());
+
+    // Step n presses its key before the first instruction of frame n * hold_frames, where the interpreter applies
+    // scripted keys, so the first step starts at frame 0.
+    std::vector<std::unique_ptr<Node>> beam;
+    beam.emplace_back(new Node{ start, {} });
+    beam[0]->machine.SetCyclesPerSecond(cycles_per_second);
+    beam[0]->machine.SaveBaseline();
+
+    WorkStealingPool pool(threads);
+    std::vector<std::unique_ptr<chip8>> scratch;
+    for (int i = 0; i < threads; ++i)
+        scratch.emplace_back(new chip8(beam[0]->machine));
+
+    VisitedSet visited;
+    SearchResult result;
+    result.score = Score(beam[0]->machine, goal);
+    result.state_hash = beam[0]->machine.GetStateHash();
+    result.reached = goal.has_target && result.score >= goal.target;
+
+    std::vector<Child> children;
+    for (int depth = 0; depth < options.max_depth && !result.reached && !beam.empty(); ++depth) {
+        // Expand: each task is one beam state with every action, replayed on the worker's copy.
+        // Reset rolls the copy back to the parent, it is the copy's baseline.
+        children.assign(beam.size() * action_count, Child{ UINT64_MAX, 0, 0 });
+        pool.Run(static_cast<int>(beam.size()), [&](int parent, int worker) {
+            chip8& machine = *scratch[worker];
+            machine = beam[parent]->machine;
+            for (int a = 0; a < action_count; ++a) {
+                ApplyAction(machine, actions[a]);
+                machine.RunFrames(options.hold_frames, 0, 0);
+
+                if (machine.GetStatus() == Status::Running) {
+                    Child& child = children[parent * action_count + a];
+                    child.claim = static_cast<uint64_t>(depth) << 40 | static_cast<uint64_t>(parent) << 8 | a;
+                    child.hash = machine.GetStateHash();
+                    child.score = Score(machine, goal);
+                    visited.Claim(child.hash, child.claim);
+                }
+                machine.Reset();
+            }
+        });
+        result.expanded += children.size();
+
+        // Select: the best new states, each state once.
+        std::erase_if(children, [&](Child const& child) {
+            return child.claim == UINT64_MAX || !visited.Owns(child.hash, child.claim);
+        });
+        size_t keep = std::min(children.size(), static_cast<size_t>(options.beam_width));
+        std::partial_sort(children.begin(), children.begin() + keep, children.end(), [](Child const& a, Child const& b) {
+            return a.score != b.score ? a.score > b.score : a.claim < b.claim;
+        });
+        children.resize(keep);
+
+        // Materialize the survivors from their parents.
+        std::vector<std::unique_ptr<Node>> next(keep);
+        pool.Run(static_cast<int>(keep), [&](int i, int) {
+            Node const& parent = *beam[children[i].claim >> 8 & 0xFFFFFFFF];
+            int8_t action = actions[children[i].claim & 0xFF];
+            next[i].reset(new Node{ parent.machine, parent.actions });
+            ApplyAction(next[i]->machine, action);
+            next[i]->machine.RunFrames(options.hold_frames, 0, 0);
+            next[i]->machine.SaveBaseline();
+            next[i]->actions.push_back(action);
+        });
+        beam = std::move(next);
+
+        if (!beam.empty() && children[0].score > result.score) {
+            result.score = children[0].score;
+            result.actions = beam[0]->actions;
+            result.state_hash = beam[0]->machine.GetStateHash();
+            result.reached = goal.has_target && result.score >= goal.target;
+        }
+    }
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return result;
+}
+
+void WriteInputScript(std::ostream& out, SearchResult const& result, SearchOptions const& options, uint64_t seed) {
+    out << "# Found by CHIP8-Search, score " << result.score << "\n";
+    out << "# Replay with --seed " << seed;
+    if (options.cycles_per_frame)
+        out << " --cycles " << options.cycles_per_frame;
+    out << "\n";
+    int8_t held = -1;
+    for (size_t step = 0; step <= result.actions.size(); ++step) {
+        int8_t action = step < result.actions.size() ? result.actions[step] : -1;
+        if (action == held)
+            continue;
+
+        uint64_t frame = step * options.hold_frames;
+        char const* digits = "0123456789ABCDEF";
+        if (held >= 0)
+            out << frame << " " << digits[held] << " up\n";
+        if (action >= 0)
+            out << frame << " " << digits[action] << " down\n";
+        held = action;
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include "chip8.h"
+
+// What the search maximises.
+struct SearchGoal {
+    enum Kind { Bcd, Byte, Pattern };
+    Kind kind = Bcd;
+    uint16_t address = 0; // Bcd: three digits as FX33 stores them. Byte: one value.
+    std::vector<unsigned char> pattern; // Pattern: palette index per pixel, row major. Score is minus the differing pixels.
+    int pattern_width = 0;
+    int pattern_height = 0;
+    bool has_target = false; // Stop as soon as a state scores at least target.
+    int64_t target = 0;
+};
+
+struct SearchOptions {
+    int beam_width = 64;
+    int max_depth = 200; // Actions per path.
+    int hold_frames = 4; // Frames each action is held for.
+    int cycles_per_frame = 0; // 0 for the frontend default of 500Hz.
+    std::vector<uint8_t> keys; // Keypad keys to try, every action presses one of them or nothing.
+    int threads = 0; // 0 for one per hardware thread.
+};
+
+struct SearchResult {
+    std::vector<int8_t> actions; // Key held for each step, -1 for none.
+    int64_t score = 0;
+    bool reached = false;
+    uint64_t state_hash = 0; // Of the machine at the end of actions.
+    uint64_t expanded = 0; // States simulated.
+    double seconds = 0;
+};
+
+// Beam search over keypad inputs from start. Every beam state is a snapshot; its children are
+// simulated on per-worker copies of it and states reached before, by hash, are pruned.
+SearchResult RunSearch(chip8 const& start, SearchGoal const& goal, SearchOptions const& options);
+
+// The path as an input script for --input-script, one step every hold_frames frames. The header says the
+// --seed and --cycles to replay it with, CXNN only follows the path with the seed it was found with.
+void WriteInputScript(std::ostream& out, SearchResult const& result, SearchOptions const& options, uint64_t seed);
+
+#endif
@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include "chip8.h"
+#include "romdb.h"
+#include "search.h"
+
+// Reads a PGM written by --final-frame back into palette indices.
+bool LoadPattern(char const* filename, SearchGoal& goal) {
+    std::ifstream file(filename, std::ios::binary);
+    std::string magic;
+    int max_value;
+    if (!(file >> magic >> goal.pattern_width >> goal.pattern_height >> max_value) || magic != "P5" || max_value != 255)
+        return false;
+    file.get();
+
+    goal.pattern.resize(static_cast<size_t>(goal.pattern_width) * goal.pattern_height);
+    for (unsigned char& pixel : goal.pattern)
+        pixel = static_cast<unsigned char>(file.get() / 85);
+    return static_cast<bool>(file);
+}
+
+// Searches keypad inputs that maximise a memory value or reach a screen, and writes the best path as an input script.
+int main(int argc, char **argv) {
+    SearchGoal goal;
+    SearchOptions options;
+    char const* machine_name = nullptr;
+    char const* out_file = nullptr;
+    uint64_t seed = 1;
+    bool has_goal = false;
+    int arg = 1;
+
+    for (; arg < argc && argv[arg][0] == '-'; ++arg) {
+        if (strcmp(argv[arg], "--bcd") == 0 && arg + 1 < argc) {
+            goal.kind = SearchGoal::Bcd;
+            goal.address = static_cast<uint16_t>(std::stoul(argv[++arg], nullptr, 16));
+            has_goal = true;
+        }
+        else if (strcmp(argv[arg], "--byte") == 0 && arg + 1 < argc) {
+            goal.kind = SearchGoal::Byte;
+            goal.address = static_cast<uint16_t>(std::stoul(argv[++arg], nullptr, 16));
+            has_goal = true;
+        }
+        else if (strcmp(argv[arg], "--pattern") == 0 && arg + 1 < argc) {
+            goal.kind = SearchGoal::Pattern;
+            if (!LoadPattern(argv[++arg], goal)) {
+                std::cerr << "Can't read the pattern, expected a PGM from --final-frame.\n";
+                return 1;
+            }
+            goal.has_target = true; // Every pixel matches.
+            has_goal = true;
+        }
+        else if (strcmp(argv[arg], "--target") == 0 && arg + 1 < argc) {
+            goal.target = std::stoll(argv[++arg]);
+            goal.has_target = true;
+        }
+        else if (strcmp(argv[arg], "--keys") == 0 && arg + 1 < argc) {
+            for (char const* key = argv[++arg]; *key; ++key)
+                options.keys.push_back(static_cast<uint8_t>(std::stoi(std::string(1, *key), nullptr, 16)));
+        }
+        else if (strcmp(argv[arg], "--beam") == 0 && arg + 1 < argc)
+            options.beam_width = std::stoi(argv[++arg]);
+        else if (strcmp(argv[arg], "--depth") == 0 && arg + 1 < argc)
+            options.max_depth = std::stoi(argv[++arg]);
+        else if (strcmp(argv[arg], "--hold") == 0 && arg + 1 < argc)
+            options.hold_frames = std::max(1, std::stoi(argv[++arg]));
+        else if (strcmp(argv[arg], "--cycles") == 0 && arg + 1 < argc)
+            options.cycles_per_frame = std::stoi(argv[++arg]);
+        else if (strcmp(argv[arg], "--threads") == 0 && arg + 1 < argc)
+            options.threads = std::stoi(argv[++arg]);
+        else if (strcmp(argv[arg], "--machine") == 0 && arg + 1 < argc)
+            machine_name = argv[++arg];
+        else if (strcmp(argv[arg], "--seed") == 0 && arg + 1 < argc)
+            seed = std::stoull(argv[++arg]);
+        else if (strcmp(argv[arg], "--out") == 0 && arg + 1 < argc)
+            out_file = argv[++arg];
+        else
+            break;
+    }
+
+    if (arg + 1 != argc || !has_goal || options.keys.empty()) {
+        std::cerr << "Usage: " << argv[0] << " (--bcd <addr> | --byte <addr> | --pattern <pgm>) --keys <hex keys> [options] <ROM>\n"
+                  << "  --target <n>     Stop once the score reaches n\n"
+                  << "  --beam <n>       States kept per step, default 64\n"
+                  << "  --depth <n>      Steps to search, default 200\n"
+                  << "  --hold <frames>  Frames each step holds its key, default 4\n"
+                  << "  --cycles <n>     Instructions per frame, as given to the interpreter\n"
+                  << "  --threads <n>    Worker threads, default one per hardware thread\n"
+                  << "  --machine <name> chip8, schip or xochip, instead of the ROM database\n"
+                  << "  --seed <n>       CXNN seed\n"
+                  << "  --out <file>     Input script to write, default stdout\n";
+        return 1;
+    }
+
+    std::unique_ptr<chip8> start(new chip8);
+    start->Initialize();
+    start->SetSeed(seed);
+    start->LoadGame(argv[arg]);
+
+    MachineSetup setup;
+    if (!ResolveMachine(start->GetRomSha1(), machine_name, options.cycles_per_frame, setup))
+        return 1;
+    start->SetQuirks(setup.quirks);
+    options.cycles_per_frame = setup.cycles_per_frame;
+
+    SearchResult result = RunSearch(*start, goal, options);
+    std::cerr << "Score " << result.score << (result.reached ? " (target reached)" : "") << " in " << result.actions.size()
+              << " steps, " << result.expanded << " states in " << result.seconds << "s, "
+              << static_cast<uint64_t>(result.expanded / std::max(result.seconds, 1e-9)) << " states/s\n";
+
+    if (out_file) {
+        std::ofstream out(out_file);
+        WriteInputScript(out, result, options, seed);
+    }
+    else
+        WriteInputScript(std::cout, result, options, seed);
+    return result.reached || !goal.has_target ? 0 : 2;
+}
@@ -0,0 +1,39 @@
+#include "simd.h"
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+SimdLevel DetectSimdLevel() {
+    SimdLevel level = SimdLevel::Scalar;
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2"))
+        level = SimdLevel::AVX2;
+    else if (__builtin_cpu_supports("sse2"))
+        level = SimdLevel::SSE2;
+#endif
+
+    if (char const* cap = std::getenv("CHIP8_SIMD")) {
+        if (strcmp(cap, "scalar") == 0)
+            level = SimdLevel::Scalar;
+        else if (strcmp(cap, "sse2") == 0 && level > SimdLevel::SSE2)
+            level = SimdLevel::SSE2;
+    }
+    return level;
+}
+
+}
+
+SimdLevel GetSimdLevel() {
+    static const SimdLevel level = DetectSimdLevel();
+    return level;
+}
+
+char const* SimdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::Scalar: return "scalar";
+        case SimdLevel::SSE2: return "sse2";
+        case SimdLevel::AVX2: return "avx2";
+    }
+    return "scalar";
+}
@@ -0,0 +1,11 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// The widest vector kernels the host CPU can run. CHIP8_SIMD=scalar, sse2 or avx2 in the environment
+// lowers it, so CHIP8-Bench can compare the kernels on one machine. Read once, on first use.
+enum class SimdLevel { Scalar, SSE2, AVX2 };
+
+SimdLevel GetSimdLevel();
+char const* SimdLevelName(SimdLevel level);
+
+#endif
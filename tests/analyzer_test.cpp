@@ -0,0 +1,25 @@
+#include <iostream>
+#include <vector>
+#include "analyzer.h"
+
+// A call and a skip in the last word of a full size ROM have their return address and skipped
+// instruction past the end of memory, the analysis has to stop there instead of marking them.
+int main() {
+    const size_t FULL_ROM = 65536 - 0x200;
+    const uint16_t LAST_WORDS[] = { 0x2200, 0x3000, 0xE09E };
+
+    int failures = 0;
+    for (uint16_t opcode : LAST_WORDS) {
+        std::vector<unsigned char> rom(FULL_ROM, 0);
+        rom[FULL_ROM - 2] = static_cast<unsigned char>(opcode >> 8);
+        rom[FULL_ROM - 1] = static_cast<unsigned char>(opcode);
+
+        RomAnalysis analysis;
+        AnalyzeRom(rom.data(), rom.size(), analysis);
+        if (!analysis.code.test(0xFFFE) || !analysis.code.test(0xFFFF)) {
+            std::cerr << "Last instruction " << std::hex << opcode << " not analyzed\n";
+            ++failures;
+        }
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,38 @@
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include "chip8.h"
+#include "romdb.h"
+
+// Looks up a ROM whose hash is in romdb.inc and one that isn't, run by ctest with the ROM as its argument.
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " <ROM in romdb.inc>\n";
+        return 1;
+    }
+
+    std::unique_ptr<chip8> machine(new chip8);
+    machine->Initialize();
+    machine->LoadGame(argv[1]);
+
+    RomInfo const* info = LookupRom(machine->GetRomSha1());
+    if (!info) {
+        std::cerr << "Not in the database: " << argv[1] << "\n";
+        return 1;
+    }
+    if (info->machine != Machine::Chip8 || info->cycles_per_frame != 15) {
+        std::cerr << "Wrong entry for " << argv[1] << ": " << info->title << "\n";
+        return 1;
+    }
+
+    unsigned char unknown[20];
+    memcpy(unknown, machine->GetRomSha1(), sizeof(unknown));
+    unknown[19] ^= 1;
+    if (LookupRom(unknown)) {
+        std::cerr << "Found a hash that isn't in the database\n";
+        return 1;
+    }
+
+    std::cout << argv[1] << ": " << info->title << "\n";
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include "chip8.h"
+#include "input_queue.h"
+#include "input_script.h"
+#include "search.h"
+
+const int FRAME_HZ = 60;
+const uint64_t FRAME_DELAY = 1000000000 / FRAME_HZ; // Nanoseconds, the interpreter's clock.
+
+// Replays the script the way the interpreter's emulation thread does: injected into the core's queue before each
+// frame, run as one batch spread over frame_delay, with an input hook for the first key read.
+uint64_t Replay(char const* rom, char const* script_file, SearchOptions const& options, uint64_t frames, uint64_t frame_delay) {
+    chip8 machine;
+    machine.Initialize();
+    machine.SetSeed(1);
+    machine.LoadGame(rom);
+    machine.SetCyclesPerSecond(options.cycles_per_frame * FRAME_HZ);
+
+    KeyEventQueue queue;
+    InputScript script;
+    script.Load(script_file);
+    machine.SetInputQueue(&queue);
+    machine.SetInputHook([]() {});
+
+    uint64_t frame_start = 1000000000;
+    for (uint64_t frame = 0; frame < frames; ++frame) {
+        script.Inject(frame, frame_start - frame_delay - 1, queue);
+        machine.RunCycles(machine.GetFrameCycles(1), frame_start - frame_delay, frame_start);
+        frame_start += frame_delay;
+    }
+    return machine.GetStateHash();
+}
+
+// The search presses keys where the interpreter applies scripted ones, so its path replays to the same state,
+// at full speed and in real time.
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " <ROM>\n";
+        return 1;
+    }
+
+    chip8 start;
+    start.Initialize();
+    start.SetSeed(1);
+    start.LoadGame(argv[1]);
+
+    SearchGoal goal;
+    goal.kind = SearchGoal::Bcd;
+    goal.address = 0x300;
+    SearchOptions options;
+    options.keys = { 0, 1 };
+    options.beam_width = 8;
+    options.max_depth = 24;
+    options.hold_frames = 1;
+    options.cycles_per_frame = 9;
+    options.threads = 2;
+    SearchResult result = RunSearch(start, goal, options);
+
+    char const* script_file = "search_replay_test.txt";
+    {
+        std::ofstream out(script_file);
+        WriteInputScript(out, result, options, 1);
+    }
+
+    uint64_t frames = result.actions.size() * options.hold_frames;
+    int failures = 0;
+    for (uint64_t frame_delay : { uint64_t(0), FRAME_DELAY }) {
+        uint64_t replayed = Replay(argv[1], script_file, options, frames, frame_delay);
+        if (replayed != result.state_hash) {
+            std::cerr << "Replay with frame delay " << frame_delay << " ended in state " << std::hex << replayed
+                      << ", the search in " << result.state_hash << std::dec << "\n";
+            ++failures;
+        }
+    }
+    std::remove(script_file);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,37 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free hand-off of the latest value from one producer thread to one consumer thread.
+// The producer fills its back slot and swaps it with the middle one, the consumer swaps the
+// middle slot with its front one when it holds something new. Neither side ever waits, the
+// consumer just skips values that were replaced before it got to them.
+template <typename T>
+class TripleBuffer {
+public:
+    // Producer: the slot to fill, then Publish it.
+    T& Back() { return slots[back]; }
+    void Publish() { back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX; }
+
+    // Consumer: takes the newest published value into Front, returns false if there is none since the last call.
+    bool Acquire() {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH))
+            return false;
+        front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+    T const& Front() const { return slots[front]; }
+
+private:
+    static constexpr uint8_t INDEX = 3;
+    static constexpr uint8_t FRESH = 4; // The middle slot was published and not acquired yet.
+
+    alignas(64) T slots[3] = {};
+    alignas(64) std::atomic<uint8_t> middle{1};
+    alignas(64) uint8_t back = 0; // Owned by the producer.
+    alignas(64) uint8_t front = 2; // Owned by the consumer.
+};
+
+#endif
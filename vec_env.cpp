@@ -0,0 +1,248 @@
+#include "vec_env.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "chip8.h"
+#include "frame_ring.h"
+#include "mapped_file.h"
+#include "romdb.h"
+
+namespace {
+
+const int CHUNK = 8; // Environments a worker takes at a time.
+const int PACKED_SIZE = 2 * 64 * 16;
+const int BYTES_SIZE = 128 * 64;
+
+}
+
+struct VecEnv {
+    std::vector<chip8> machines; // Copies of one loaded machine, sharing its baseline.
+    std::vector<uint64_t> episode_frames;
+    std::vector<uint64_t> episodes;
+    uint64_t max_episode_frames = 0;
+    int format = VEC_ENV_OBS_PACKED;
+    unsigned char* observations = nullptr;
+    FrameRing frame_ring;
+
+    // The current job, read by the workers once they see a new generation.
+    uint16_t const* actions = nullptr;
+    uint8_t* dones = nullptr;
+    bool resetting = false;
+    std::atomic<int> next_env{0};
+    std::atomic<int> busy{0};
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    uint64_t generation = 0;
+    bool stop = false;
+
+    void Observe(int i);
+    void ResetEnv(int i);
+    void StepEnv(int i);
+    void Work();
+    void Run();
+    void WorkerLoop();
+};
+
+void VecEnv::Observe(int i) {
+    chip8& machine = machines[i];
+    if (frame_ring.Instances())
+        frame_ring.Publish(i, machine.GetGFX());
+    if (!observations)
+        return;
+
+    if (format == VEC_ENV_OBS_PACKED) {
+        unsigned char* out = observations + static_cast<size_t>(i) * PACKED_SIZE;
+        for (int plane = 0; plane < 2; ++plane) {
+            PackedRow const* rows = machine.GetPlane(plane);
+            for (int row = 0; row < 64; ++row, out += 16)
+                for (int byte = 0; byte < 16; ++byte)
+                    out[byte] = static_cast<unsigned char>(rows[row] >> (120 - 8 * byte));
+        }
+    }
+    else {
+        // Eight pixels at a time: a plane byte spread to one bit per output byte.
+        static const auto spread = [] {
+            std::array<uint64_t, 256> table{};
+            for (int bits = 0; bits < 256; ++bits)
+                for (int x = 0; x < 8; ++x)
+                    if (bits & (0x80 >> x))
+                        table[bits] |= 1ULL << (8 * x);
+            return table;
+        }();
+
+        unsigned char* out = observations + static_cast<size_t>(i) * BYTES_SIZE;
+        PackedRow const* plane0 = machine.GetPlane(0);
+        PackedRow const* plane1 = machine.GetPlane(1);
+        for (int row = 0; row < 64; ++row) {
+            for (int byte = 0; byte < 16; ++byte, out += 8) {
+                int shift = 120 - 8 * byte;
+                uint64_t pixels = spread[static_cast<unsigned>(plane0[row] >> shift) & 0xFF]
+                                | spread[static_cast<unsigned>(plane1[row] >> shift) & 0xFF] << 1;
+                memcpy(out, &pixels, sizeof(pixels)); // Little endian hosts, leftmost pixel first.
+            }
+        }
+    }
+}
+
+// Back to the snapshot taken after loading, with fresh random numbers for the new episode.
+void VecEnv::ResetEnv(int i) {
+    chip8& machine = machines[i];
+    machine.Reset();
+    machine.SetSeed((++episodes[i] * machines.size() + i) * 0x9E3779B97F4A7C15ULL);
+    episode_frames[i] = 0;
+    Observe(i);
+}
+
+void VecEnv::StepEnv(int i) {
+    chip8& machine = machines[i];
+    machine.keypad.Set(actions ? actions[i] : 0);
+
+    machine.RunFrames(1, 0, 0);
+    ++episode_frames[i];
+
+    bool done = machine.GetStatus() != Status::Running || (max_episode_frames && episode_frames[i] >= max_episode_frames);
+    if (dones)
+        dones[i] = done;
+    if (done)
+        ResetEnv(i);
+    else
+        Observe(i);
+}
+
+// Takes chunks of environments until none are left. Run by the caller's thread and every worker.
+void VecEnv::Work() {
+    int n = static_cast<int>(machines.size());
+    for (int first = next_env.fetch_add(CHUNK); first < n; first = next_env.fetch_add(CHUNK))
+        for (int i = first; i < first + CHUNK && i < n; ++i)
+            resetting ? ResetEnv(i) : StepEnv(i);
+}
+
+void VecEnv::Run() {
+    next_env = 0;
+    busy = static_cast<int>(workers.size());
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++generation;
+    }
+    wake.notify_all();
+
+    Work();
+    for (int left = busy.load(); left != 0; left = busy.load())
+        busy.wait(left);
+}
+
+void VecEnv::WorkerLoop() {
+    uint64_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stop || generation != seen; });
+            if (stop)
+                return;
+            seen = generation;
+        }
+
+        Work();
+        if (busy.fetch_sub(1) == 1)
+            busy.notify_one();
+    }
+}
+
+extern "C" {
+
+VecEnv* vec_env_create(char const* rom, int n) {
+    if (n <= 0)
+        return nullptr;
+
+    MappedFile file;
+    std::unique_ptr<chip8> prototype(new chip8);
+    prototype->Initialize();
+    if (!file.Open(rom) || !prototype->LoadGame(file.Data(), file.Size()))
+        return nullptr;
+
+    MachineSetup setup;
+    ResolveMachine(prototype->GetRomSha1(), nullptr, 0, setup);
+    prototype->SetQuirks(setup.quirks);
+    int cycles_per_frame = setup.cycles_per_frame ? setup.cycles_per_frame : 9; // About 500Hz for unknown CHIP-8 ROMs.
+    prototype->SetCyclesPerSecond(cycles_per_frame * 60);
+    prototype->SaveBaseline();
+
+    VecEnv* env = new VecEnv;
+    env->machines.assign(n, *prototype);
+    env->episode_frames.assign(n, 0);
+    env->episodes.assign(n, 0);
+
+    // The caller's thread is one of the workers.
+    int threads = std::min<int>(std::max(1u, std::thread::hardware_concurrency()), (n + CHUNK - 1) / CHUNK);
+    for (int i = 1; i < threads; ++i)
+        env->workers.emplace_back(&VecEnv::WorkerLoop, env);
+
+    vec_env_reset(env);
+    return env;
+}
+
+void vec_env_destroy(VecEnv* env) {
+    if (!env)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(env->mutex);
+        env->stop = true;
+    }
+    env->wake.notify_all();
+    for (std::thread& worker : env->workers)
+        worker.join();
+    delete env;
+}
+
+int vec_env_num_envs(VecEnv const* env) {
+    return static_cast<int>(env->machines.size());
+}
+
+// Every step is one whole frame, so the machines are always between frames here.
+void vec_env_set_cycles_per_frame(VecEnv* env, int cycles) {
+    if (cycles > 0)
+        for (chip8& machine : env->machines)
+            machine.SetCyclesPerSecond(cycles * 60);
+}
+
+void vec_env_set_max_episode_frames(VecEnv* env, uint64_t max_frames) {
+    env->max_episode_frames = max_frames;
+}
+
+size_t vec_env_observation_size(int format) {
+    return format == VEC_ENV_OBS_BYTES ? BYTES_SIZE : PACKED_SIZE;
+}
+
+void vec_env_set_observations(VecEnv* env, int format, void* buffer) {
+    env->format = format;
+    env->observations = static_cast<unsigned char*>(buffer);
+    for (int i = 0; i < vec_env_num_envs(env); ++i)
+        env->Observe(i);
+}
+
+int vec_env_set_frame_ring(VecEnv* env, char const* shm_name, int depth) {
+    return depth > 0 && env->frame_ring.Create(shm_name, vec_env_num_envs(env), depth);
+}
+
+void vec_env_reset(VecEnv* env) {
+    env->resetting = true;
+    env->Run();
+}
+
+void vec_env_step(VecEnv* env, uint16_t const* actions, uint8_t* dones) {
+    env->actions = actions;
+    env->dones = dones;
+    env->resetting = false;
+    env->Run();
+}
+
+}
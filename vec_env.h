@@ -0,0 +1,57 @@
+#ifndef VEC_ENV_H
+#define VEC_ENV_H
+
+// C API for stepping many machines at once, e.g. from a reinforcement learning trainer.
+// Every environment runs the same ROM. Steps are one emulated frame, spread over worker threads.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#define VEC_ENV_API __declspec(dllexport)
+#else
+#define VEC_ENV_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct VecEnv VecEnv;
+
+// Observation layouts, per environment.
+enum {
+    VEC_ENV_OBS_PACKED = 0, // Two bitplanes of 64 rows, 16 bytes per row, leftmost pixel in bit 7 of the first byte.
+    VEC_ENV_OBS_BYTES = 1 // 128x64 palette indices (0-3), one byte per pixel. Lores uses the top-left 64x32.
+};
+
+// NULL if the ROM can't be loaded.
+VEC_ENV_API VecEnv* vec_env_create(char const* rom, int n);
+VEC_ENV_API void vec_env_destroy(VecEnv* env);
+VEC_ENV_API int vec_env_num_envs(VecEnv const* env);
+
+// Instructions per step, the ROM database speed by default. Episodes longer than max_frames are cut, 0 for no limit.
+VEC_ENV_API void vec_env_set_cycles_per_frame(VecEnv* env, int cycles);
+VEC_ENV_API void vec_env_set_max_episode_frames(VecEnv* env, uint64_t max_frames);
+
+// Bytes of one environment's observation. buffer holds n of them back to back and is written
+// in place by every reset and step, it must stay valid until it is replaced or the env destroyed.
+VEC_ENV_API size_t vec_env_observation_size(int format);
+VEC_ENV_API void vec_env_set_observations(VecEnv* env, int format, void* buffer);
+
+// Also publishes every frame to a ring of the last depth frames per environment, in the POSIX shared
+// memory segment shm_name (see frame_ring.h). Returns 0 if the segment can't be created.
+VEC_ENV_API int vec_env_set_frame_ring(VecEnv* env, char const* shm_name, int depth);
+
+// Starts a new episode in every environment.
+VEC_ENV_API void vec_env_reset(VecEnv* env);
+
+// actions[i] is the keypad bitmask held during this frame, bit k for key k. dones[i] is set when the
+// episode ended, the environment is then already reset and its observation is the first of the next episode.
+VEC_ENV_API void vec_env_step(VecEnv* env, uint16_t const* actions, uint8_t* dones);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef VIP_TIMING_H
+#define VIP_TIMING_H
+
+#include <cstdint>
+
+// Instruction timing policies, picked at compile time by CHIP8_VIP_TIMING.
+// RunCycles charges every instruction Timing::Cycles against the frame budget, so with the
+// default policy a cycle is an instruction and the timing code compiles away.
+
+// The fast default: every instruction is one cycle and the host chooses cycles per frame.
+struct UnitTiming {
+    static constexpr bool CYCLE_ACCURATE = false;
+    static constexpr int FRAME_CYCLES = 0;
+    static constexpr int Cycles(uint16_t, unsigned char, unsigned char, bool) { return 1; }
+};
+
+// COSMAC VIP: cycles are 1802 machine cycles of 8 clocks at 1.76064 MHz. The CDP1861 draws 262 lines of
+// 14 machine cycles per frame. For the 128 displayed lines the CPU sits in the CHIP-8 interpreter's display
+// interrupt while DMA fetches the pixels, and entering and leaving the interrupt plus the timer updates take
+// some more. What is left is the interpreter's budget per frame.
+constexpr int VIP_CLOCK_HZ = 1760640;
+constexpr int VIP_CLOCKS_PER_MACHINE_CYCLE = 8;
+constexpr int VIP_CYCLES_PER_LINE = 14;
+constexpr int VIP_LINES_PER_FRAME = 262;
+constexpr int VIP_DISPLAY_LINES = 128;
+constexpr int VIP_INTERRUPT_OVERHEAD = 44;
+constexpr int VIP_CYCLES_PER_FRAME = VIP_CYCLES_PER_LINE * VIP_LINES_PER_FRAME;
+constexpr int VIP_INTERRUPT_CYCLES = VIP_CYCLES_PER_LINE * VIP_DISPLAY_LINES + VIP_INTERRUPT_OVERHEAD;
+constexpr int VIP_INTERPRETER_CYCLES = VIP_CYCLES_PER_FRAME - VIP_INTERRUPT_CYCLES;
+
+// Costs of the interpreter's routines in machine cycles, after its fetch and dispatch. Each 1802
+// instruction takes 2 machine cycles (long branches 3), these follow the routines in the interpreter
+// listing, with loops charged per pass.
+constexpr int VIP_FETCH = 40;
+constexpr int VIP_SKIP = 4; // Taken skips of 3XNN, 4XNN, 5XY0, 9XY0, EX9E and EXA1 step pc once more.
+constexpr int VIP_CLEAR_BYTE = 6; // 00E0 clears the 256 display bytes one by one.
+constexpr int VIP_DIGIT = 16; // FX33 counts each decimal digit down by repeated subtraction.
+constexpr int VIP_REGISTER = 14; // FX55 and FX65 copy one register per pass.
+constexpr int VIP_DRAW_SETUP = 26; // DXYN works out the display address from VX and VY.
+constexpr int VIP_DRAW_ROW = 20; // Loading a sprite byte, XORing it in and checking for a collision.
+constexpr int VIP_DRAW_SHIFT = 8; // Every bit of misalignment shifts each row one more time...
+constexpr int VIP_DRAW_SECOND_BYTE = 12; // ...and a misaligned row touches a second display byte.
+
+struct VipTiming {
+    static constexpr bool CYCLE_ACCURATE = true;
+    static constexpr int FRAME_CYCLES = VIP_INTERPRETER_CYCLES;
+
+    // Machine cycles of opcode, given VX, VY and whether key VX is down before it runs.
+    static constexpr int Cycles(uint16_t opcode, unsigned char vx, unsigned char vy, bool vx_key_down) {
+        int nn = opcode & 0xFF;
+        switch (opcode & 0xF000) {
+            case 0x0000:
+                if (opcode == 0x00E0)
+                    return VIP_FETCH + 24 + 256 * VIP_CLEAR_BYTE;
+                if (opcode == 0x00EE)
+                    return VIP_FETCH + 10;
+                return VIP_FETCH; // 0NNN machine code is not timed.
+            case 0x1000: return VIP_FETCH + 12;
+            case 0x2000: return VIP_FETCH + 26;
+            case 0x3000: return VIP_FETCH + 10 + (vx == nn ? VIP_SKIP : 0);
+            case 0x4000: return VIP_FETCH + 10 + (vx != nn ? VIP_SKIP : 0);
+            case 0x5000: return VIP_FETCH + 14 + (vx == vy ? VIP_SKIP : 0);
+            case 0x6000: return VIP_FETCH + 6;
+            case 0x7000: return VIP_FETCH + 10;
+            case 0x8000: return VIP_FETCH + 44;
+            case 0x9000: return VIP_FETCH + 14 + (vx != vy ? VIP_SKIP : 0);
+            case 0xA000: return VIP_FETCH + 12;
+            case 0xB000: return VIP_FETCH + 22;
+            case 0xC000: return VIP_FETCH + 36;
+            case 0xD000: {
+                int rows = opcode & 0xF;
+                int shift = vx & 7;
+                return VIP_FETCH + VIP_DRAW_SETUP
+                    + rows * (VIP_DRAW_ROW + shift * VIP_DRAW_SHIFT + (shift ? VIP_DRAW_SECOND_BYTE : 0));
+            }
+            case 0xE000:
+                if (nn == 0x9E)
+                    return VIP_FETCH + 14 + (vx_key_down ? VIP_SKIP : 0);
+                return VIP_FETCH + 14 + (vx_key_down ? 0 : VIP_SKIP);
+            case 0xF000:
+                switch (nn) {
+                    case 0x0A: return VIP_FETCH + 19; // Per poll while waiting.
+                    case 0x1E: return VIP_FETCH + 16;
+                    case 0x29: return VIP_FETCH + 16;
+                    case 0x33: return VIP_FETCH + 80 + VIP_DIGIT * (vx / 100 + vx / 10 % 10 + vx % 10);
+                    case 0x55:
+                    case 0x65: return VIP_FETCH + 14 + VIP_REGISTER * ((opcode >> 8 & 0xF) + 1);
+                    default: return VIP_FETCH + 10; // FX07, FX15 and FX18.
+                }
+        }
+        return VIP_FETCH;
+    }
+};
+
+// The frame: 3668 machine cycles at 60Hz, about half of them left to the interpreter.
+static_assert(VIP_CYCLES_PER_FRAME == 3668);
+static_assert(VIP_CLOCK_HZ / VIP_CLOCKS_PER_MACHINE_CYCLE / VIP_CYCLES_PER_FRAME == 60);
+static_assert(VIP_INTERPRETER_CYCLES == 1832);
+
+// Instruction costs.
+static_assert(VipTiming::Cycles(0x6A12, 0, 0, false) == 46);
+static_assert(VipTiming::Cycles(0x7A01, 0, 0, false) == 50);
+static_assert(VipTiming::Cycles(0x8124, 0, 0, false) == 84);
+static_assert(VipTiming::Cycles(0x1200, 0, 0, false) == 52);
+static_assert(VipTiming::Cycles(0x00E0, 0, 0, false) == 1600);
+static_assert(VipTiming::Cycles(0x3A05, 5, 0, false) == VipTiming::Cycles(0x3A05, 4, 0, false) + VIP_SKIP);
+static_assert(VipTiming::Cycles(0x4A05, 4, 0, false) == VipTiming::Cycles(0x4A05, 5, 0, false) + VIP_SKIP);
+static_assert(VipTiming::Cycles(0xEA9E, 0, 0, true) == VipTiming::Cycles(0xEAA1, 0, 0, false));
+static_assert(VipTiming::Cycles(0xF033, 255, 0, false) == 40 + 80 + 16 * 12);
+static_assert(VipTiming::Cycles(0xFF55, 0, 0, false) == 40 + 14 + 14 * 16);
+
+// DXYN: aligned sprites skip the shifting and the second byte, every row costs the same.
+static_assert(VipTiming::Cycles(0xD015, 8, 0, false) == 40 + 26 + 5 * 20);
+static_assert(VipTiming::Cycles(0xD015, 9, 0, false) == 40 + 26 + 5 * (20 + 8 + 12));
+static_assert(VipTiming::Cycles(0xD01F, 7, 0, false) == 40 + 26 + 15 * (20 + 56 + 12));
+
+// Any one instruction fits in a frame, so a frame overrun never swallows the next frame whole.
+static_assert(VipTiming::Cycles(0x00E0, 0, 0, false) < VIP_INTERPRETER_CYCLES);
+static_assert(VipTiming::Cycles(0xD01F, 7, 0, false) < VIP_INTERPRETER_CYCLES);
+
+#ifdef CHIP8_VIP_TIMING
+using Timing = VipTiming;
+#else
+using Timing = UnitTiming;
+#endif
+
+#endif